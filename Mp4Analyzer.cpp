@@ -1,13 +1,18 @@
 
 #include "Mp4Analyzer.hpp"
 
+#include <algorithm>
 #include <array>
 #include <iostream>
 #include <vector>
 
 #include "models/Mp4Boxes.hpp"
+#include "models/SampleDecoders.hpp"
 
-Mp4Analyzer::Mp4Analyzer() {}
+Mp4Analyzer::Mp4Analyzer(bool verbose)
+    : _verbose{verbose} {}
+
+Mp4Analyzer::~Mp4Analyzer() {}
 
 bool Mp4Analyzer::open(const std::string& path) {
     _file.open(path, std::ios_base::in | std::ios_base::binary);
@@ -16,11 +21,15 @@ bool Mp4Analyzer::open(const std::string& path) {
         return false;
     }
 
+    _path = path;
+
     _file.seekg(0, std::ios_base::end);
     _length = _file.tellg();
     _file.seekg(0, std::ios_base::beg);
 
-    std::cout << "File is open, length: " << _length << std::endl;
+    if (_verbose) {
+        std::cout << "File is open, length: " << _length << std::endl;
+    }
 
     return true;
 }
@@ -65,8 +74,14 @@ struct BLOCK {
 
 namespace {
 
+    struct ReaderContext {
+        std::fstream& file;
+        bool verbose;
+    };
+
     Mp4Boxes::BoxHeader readBoxHeader(std::fstream& file, size_t startPos) {
         Mp4Boxes::BoxHeader boxHeader;
+        boxHeader.offset = startPos;
         BLOCK<4> block4Byte;
 
         file.read((char*)&block4Byte.data[0], 4);
@@ -79,6 +94,7 @@ namespace {
             BLOCK<8> block8Byte;
             file.read((char*)&block8Byte.data[0], 8);
             boxHeader.size = bytesToInt<unsigned long int>(&block8Byte.data[0]);
+            boxHeader.headerSize = 16;
         }
 
         if (boxHeader.type == "uuid") {
@@ -102,13 +118,14 @@ namespace {
         box->flags = bytesToInt<unsigned int>(&block3Byte.data[0], 3);
     }
 
-    std::function<Mp4Boxes::Box*(std::fstream&, size_t, size_t, Mp4Boxes::BoxHeader)> selectAction(const std::string& type);
+    std::function<Mp4Boxes::Box*(ReaderContext&, size_t, size_t, Mp4Boxes::BoxHeader)> selectAction(const std::string& type);
 
     Mp4Boxes::Box* recursiveReader(
-                std::fstream& file, 
+                ReaderContext& context, 
                 size_t startPos, 
                 size_t endPos, 
                 Mp4Boxes::BoxHeader header) {
+        auto& file = context.file;
         auto box = new Mp4Boxes::Box(header);
 
         size_t offset = startPos;
@@ -116,9 +133,24 @@ namespace {
 
             auto boxHeader = readBoxHeader(file, offset);
 
+            if (!file.good()) {
+                // header is not written completely yet
+                break;
+            }
+
+            if (boxHeader.size == 0) {
+                // box extends to the end of its parent
+                boxHeader.size = endPos - offset;
+            }
+
+            if (boxHeader.size < boxHeader.headerSize || offset + boxHeader.size > endPos) {
+                // truncated or corrupted box, nothing after it can be trusted
+                break;
+            }
+
             auto action = selectAction(boxHeader.type);
             if (action) {
-                box->children.emplace_back(action(file, offset + 8, offset + boxHeader.size, boxHeader));
+                box->children.emplace_back(action(context, offset + boxHeader.headerSize, offset + boxHeader.size, boxHeader));
             } else {
                 box->children.emplace_back(new Mp4Boxes::Box(boxHeader));
             }
@@ -132,10 +164,11 @@ namespace {
     };
 
     Mp4Boxes::Box* ftypReader(
-                std::fstream& file, 
+                ReaderContext& context, 
                 size_t startPos, 
                 size_t endPos, 
                 Mp4Boxes::BoxHeader header) {
+        auto& file = context.file;
         auto ftypBox = new Mp4Boxes::FtypBox(header);
 
         size_t offset = startPos;
@@ -159,18 +192,165 @@ namespace {
             offset += file.gcount();
         }
         
-        auto ftyp = ftypBox->toString();
-
-        std::cout << ftyp << std::endl;
+        if (context.verbose) {
+            std::cout << ftypBox->toString() << std::endl;
+        }
 
         return ftypBox;
     }
 
+    Mp4Boxes::Box* mvhdReader(
+                ReaderContext& context, 
+                size_t startPos, 
+                size_t endPos, 
+                Mp4Boxes::BoxHeader header) {
+        auto& file = context.file;
+
+        auto mvhdBox = new Mp4Boxes::MvhdBox(header);
+
+        readFullBox(file, mvhdBox);
+
+        BLOCK<4> block4Byte;
+        BLOCK<8> block8Byte;
+
+        if (mvhdBox->version == 1) {
+            // creation time, modification time
+            file.seekg(16, std::ios_base::cur);
+            file.read((char*)&block4Byte.data[0], 4);
+            mvhdBox->timescale = bytesToInt<unsigned int>(&block4Byte.data[0]);
+            file.read((char*)&block8Byte.data[0], 8);
+            mvhdBox->duration = bytesToInt<unsigned long int>(&block8Byte.data[0]);
+        } else {
+            file.seekg(8, std::ios_base::cur);
+            file.read((char*)&block4Byte.data[0], 4);
+            mvhdBox->timescale = bytesToInt<unsigned int>(&block4Byte.data[0]);
+            file.read((char*)&block4Byte.data[0], 4);
+            mvhdBox->duration = bytesToInt<unsigned int>(&block4Byte.data[0]);
+        }
+
+        // rate, volume, reserved, matrix, pre_defined
+        file.seekg(76, std::ios_base::cur);
+        file.read((char*)&block4Byte.data[0], 4);
+        mvhdBox->nextTrackId = bytesToInt<unsigned int>(&block4Byte.data[0]);
+
+        if (context.verbose) {
+            std::cout << mvhdBox->toString() << std::endl;
+        }
+
+        return mvhdBox;
+    };
+
+    Mp4Boxes::Box* tkhdReader(
+                ReaderContext& context, 
+                size_t startPos, 
+                size_t endPos, 
+                Mp4Boxes::BoxHeader header) {
+        auto& file = context.file;
+
+        auto tkhdBox = new Mp4Boxes::TkhdBox(header);
+
+        readFullBox(file, tkhdBox);
+
+        BLOCK<4> block4Byte;
+        BLOCK<8> block8Byte;
+
+        // creation time, modification time
+        file.seekg(tkhdBox->version == 1 ? 16 : 8, std::ios_base::cur);
+        file.read((char*)&block4Byte.data[0], 4);
+        tkhdBox->trackId = bytesToInt<unsigned int>(&block4Byte.data[0]);
+
+        // reserved
+        file.seekg(4, std::ios_base::cur);
+
+        if (tkhdBox->version == 1) {
+            file.read((char*)&block8Byte.data[0], 8);
+            tkhdBox->duration = bytesToInt<unsigned long int>(&block8Byte.data[0]);
+        } else {
+            file.read((char*)&block4Byte.data[0], 4);
+            tkhdBox->duration = bytesToInt<unsigned int>(&block4Byte.data[0]);
+        }
+
+        if (context.verbose) {
+            std::cout << tkhdBox->toString() << std::endl;
+        }
+
+        return tkhdBox;
+    };
+
+    Mp4Boxes::Box* mdhdReader(
+                ReaderContext& context, 
+                size_t startPos, 
+                size_t endPos, 
+                Mp4Boxes::BoxHeader header) {
+        auto& file = context.file;
+
+        auto mdhdBox = new Mp4Boxes::MdhdBox(header);
+
+        readFullBox(file, mdhdBox);
+
+        BLOCK<4> block4Byte;
+        BLOCK<8> block8Byte;
+
+        // creation time, modification time
+        file.seekg(mdhdBox->version == 1 ? 16 : 8, std::ios_base::cur);
+        file.read((char*)&block4Byte.data[0], 4);
+        mdhdBox->timescale = bytesToInt<unsigned int>(&block4Byte.data[0]);
+
+        if (mdhdBox->version == 1) {
+            file.read((char*)&block8Byte.data[0], 8);
+            mdhdBox->duration = bytesToInt<unsigned long int>(&block8Byte.data[0]);
+        } else {
+            file.read((char*)&block4Byte.data[0], 4);
+            mdhdBox->duration = bytesToInt<unsigned int>(&block4Byte.data[0]);
+        }
+
+        if (context.verbose) {
+            std::cout << mdhdBox->toString() << std::endl;
+        }
+
+        return mdhdBox;
+    };
+
+    Mp4Boxes::Box* trexReader(
+                ReaderContext& context, 
+                size_t startPos, 
+                size_t endPos, 
+                Mp4Boxes::BoxHeader header) {
+        auto& file = context.file;
+
+        auto trexBox = new Mp4Boxes::TrexBox(header);
+
+        readFullBox(file, trexBox);
+
+        BLOCK<4> block4Byte;
+        file.read((char*)&block4Byte.data[0], 4);
+        trexBox->trackId = bytesToInt<unsigned int>(&block4Byte.data[0]);
+
+        file.read((char*)&block4Byte.data[0], 4);
+        trexBox->defaultSampleDescriptionIndex = bytesToInt<unsigned int>(&block4Byte.data[0]);
+
+        file.read((char*)&block4Byte.data[0], 4);
+        trexBox->defaultSampleDuration = bytesToInt<unsigned int>(&block4Byte.data[0]);
+
+        file.read((char*)&block4Byte.data[0], 4);
+        trexBox->defaultSampleSize = bytesToInt<unsigned int>(&block4Byte.data[0]);
+
+        file.read((char*)&block4Byte.data[0], 4);
+        trexBox->defaultSampleFlags = bytesToInt<unsigned int>(&block4Byte.data[0]);
+
+        if (context.verbose) {
+            std::cout << trexBox->toString() << std::endl;
+        }
+
+        return trexBox;
+    };
+
     Mp4Boxes::Box* mfhdReader(
-                std::fstream& file, 
+                ReaderContext& context, 
                 size_t startPos, 
                 size_t endPos, 
                 Mp4Boxes::BoxHeader header) {
+        auto& file = context.file;
         
         auto mfhdBox = new Mp4Boxes::MfhdBox(header);
 
@@ -180,68 +360,56 @@ namespace {
         file.read((char*)&block4Byte.data[0], 4);
         mfhdBox->sequenceNumber = bytesToInt<unsigned int>(&block4Byte.data[0]);
 
-        std::cout << mfhdBox->toString() << std::endl;
+        if (context.verbose) {
+            std::cout << mfhdBox->toString() << std::endl;
+        }
 
         return mfhdBox;
     };
 
     Mp4Boxes::Box* tfhdReader(
-                std::fstream& file, 
+                ReaderContext& context, 
                 size_t startPos, 
                 size_t endPos, 
                 Mp4Boxes::BoxHeader header) {
+        auto& file = context.file;
         
         auto tfhdBox = new Mp4Boxes::TfhdBox(header);
 
         readFullBox(file, tfhdBox);
 
-        auto baseDataOffsetPresent = tfhdBox->flags & 0x00000001;
-        auto sampleDescriptionIndexPresent = tfhdBox->flags & 0x00000002;
-        auto defaultSampleDurationPresent = tfhdBox->flags & 0x00000008;
-        auto defaultSampleSizePresent = tfhdBox->flags & 0x00000010;
-        auto defaultSampleFlagsPresent = tfhdBox->flags & 0x00000020;
         auto durationIsEmpty = tfhdBox->flags & 0x00010000;
         auto defaultBaseIsMoof = tfhdBox->flags & 0x00020000;
 
         BLOCK<4> block4Byte;
-        BLOCK<8> block8Byte;
 
         file.read((char*)&block4Byte.data[0], 4);
         tfhdBox->trackId = bytesToInt<unsigned int>(&block4Byte.data[0]);
 
-        if (baseDataOffsetPresent) {
-            file.read((char*)&block8Byte.data[0], 8);
-            tfhdBox->baseDataOffset = bytesToInt<unsigned long int>(&block8Byte.data[0]);
-        }
-
-        if (sampleDescriptionIndexPresent) {
-            file.read((char*)&block4Byte.data[0], 4);
-            tfhdBox->sampleDescriptionIndex = bytesToInt<unsigned int>(&block4Byte.data[0]);
-        }
-
-        if (defaultSampleSizePresent) {
-            file.read((char*)&block4Byte.data[0], 4);
-            tfhdBox->defaultSampleSize = bytesToInt<unsigned int>(&block4Byte.data[0]);
-        }
-
-        if (defaultSampleFlagsPresent) {
-            file.read((char*)&block4Byte.data[0], 4);
-            tfhdBox->defaultSampleFlags = bytesToInt<unsigned int>(&block4Byte.data[0]);
+        // base data offset, sample description index and defaults are read at once
+        BLOCK<24> fieldsBlock;
+        auto fieldsSize = SampleDecoders::tfhdFieldsSize(tfhdBox->flags);
+        file.read((char*)&fieldsBlock.data[0], fieldsSize);
+        if (file.gcount() == static_cast<std::streamsize>(fieldsSize)) {
+            SampleDecoders::decodeTfhdFields(tfhdBox->flags, &fieldsBlock.data[0], *tfhdBox);
         }
 
         tfhdBox->durationIsEmpty = durationIsEmpty;
         tfhdBox->defaultBaseIsMoof = defaultBaseIsMoof;
 
-        std::cout << tfhdBox->toString() << std::endl;
+        if (context.verbose) {
+            std::cout << tfhdBox->toString() << std::endl;
+        }
 
         return tfhdBox;
     };
 
     Mp4Boxes::Box* tfdtReader(
-                std::fstream& file, 
+                ReaderContext& context, 
                 size_t startPos, 
                 size_t endPos, 
                 Mp4Boxes::BoxHeader header) {
+        auto& file = context.file;
         
         auto tfdtBox = new Mp4Boxes::TfdtBox(header);
 
@@ -257,16 +425,19 @@ namespace {
             tfdtBox->baseMediaDecodeTime = bytesToInt<unsigned int>(&block4Byte.data[0]);
         }
 
-        std::cout << tfdtBox->toString() << std::endl;
+        if (context.verbose) {
+            std::cout << tfdtBox->toString() << std::endl;
+        }
 
         return tfdtBox;
     };
 
     Mp4Boxes::Box* trunReader(
-                std::fstream& file, 
+                ReaderContext& context, 
                 size_t startPos, 
                 size_t endPos, 
                 Mp4Boxes::BoxHeader header) {
+        auto& file = context.file;
         
         auto trunBox = new Mp4Boxes::TrunBox(header);
 
@@ -274,10 +445,6 @@ namespace {
 
         auto dataOffsetPresent = trunBox->flags & 0x00000001;
         auto firstSampleFlagsPresent = trunBox->flags & 0x00000004;
-        auto sampleDurationPresent = trunBox->flags & 0x00000100;
-        auto sampleSizePresent = trunBox->flags & 0x00000200;
-        auto sampleFlagsPresent = trunBox->flags & 0x00000400;
-        auto sampleCompositionTimeOffsetPresent = trunBox->flags & 0x00000800;
 
         BLOCK<4> block4Byte;
         file.read((char*)&block4Byte.data[0], 4);
@@ -293,51 +460,48 @@ namespace {
             trunBox->firstSampleFlags = bytesToInt<unsigned int>(&block4Byte.data[0]);
         }
 
-        for (unsigned int i = 0; i < trunBox->sampleCount; i++) {
-            Mp4Boxes::TrunBox::TrunSample sample;
-            if (sampleDurationPresent) {
-                file.read((char*)&block4Byte.data[0], 4);
-                sample.sampleDuration = bytesToInt<unsigned int>(&block4Byte.data[0]);
-            }
-
-            if (sampleSizePresent) {
-                file.read((char*)&block4Byte.data[0], 4);
-                sample.sampleSize = bytesToInt<unsigned int>(&block4Byte.data[0]);
-            }
-
-            if (sampleFlagsPresent) {
-                file.read((char*)&block4Byte.data[0], 4);
-                sample.sampleFlags = bytesToInt<unsigned int>(&block4Byte.data[0]);
-            }
-
-            if (trunBox->version == 0) {
-                file.read((char*)&block4Byte.data[0], 4);
-                sample.sampleCompositionTimeOffset = bytesToInt<unsigned int>(&block4Byte.data[0]);
-            }
-            else {
-                file.read((char*)&block4Byte.data[0], 4);
-                sample.sampleCompositionTimeOffsetSigned = bytesToInt<int>(&block4Byte.data[0]);
-            }
-
-            trunBox->samples.push_back(sample);
+        // sample records have a fixed stride for the given flags, so the whole table is read at once.
+        // Without per-sample fields there is no table, samples stays empty and the track collector
+        // takes every sample from the defaults
+        auto sampleSize = SampleDecoders::trunSampleSize(trunBox->flags);
+        if (sampleSize > 0) {
+            // a count larger than the table is corrupted, only the records present are decoded
+            auto position = static_cast<size_t>(file.tellg());
+            auto available = endPos > position ? endPos - position : 0;
+            size_t samplesCount = std::min<size_t>(trunBox->sampleCount, available / sampleSize);
+
+            std::vector<uint8_t> samplesData(samplesCount * sampleSize);
+            file.read((char*)samplesData.data(), samplesData.size());
+            samplesCount = static_cast<size_t>(file.gcount()) / sampleSize;
+
+            SampleDecoders::decodeTrunSamples(
+                trunBox->flags, trunBox->version, samplesData.data(), samplesCount, trunBox->samples);
         }
 
-        std::cout << trunBox->toString() << std::endl;
+        if (context.verbose) {
+            std::cout << trunBox->toString() << std::endl;
+        }
 
         return trunBox;
     };
 
-    std::function<Mp4Boxes::Box*(std::fstream&, size_t, size_t, Mp4Boxes::BoxHeader)> selectAction(const std::string& type) {
+    std::function<Mp4Boxes::Box*(ReaderContext&, size_t, size_t, Mp4Boxes::BoxHeader)> selectAction(const std::string& type) {
         if (type == "ftyp") {
             return ftypReader;
         } else if (type == "moov") {
             return recursiveReader;
+        } else if (type == "mvhd") {
+            return mvhdReader;
         } else if (type == "trak") {
             return recursiveReader;
+        } else if (type == "tkhd") {
+            return tkhdReader;
         } else if (type == "edts") {
             return recursiveReader;
         } else if (type == "mdia") {
             return recursiveReader;
+        } else if (type == "mdhd") {
+            return mdhdReader;
         } else if (type == "minf") {
             return recursiveReader;
         } else if (type == "dinf") {
@@ -346,6 +510,8 @@ namespace {
             return recursiveReader;
         } else if (type == "mvex") {
             return recursiveReader;
+        } else if (type == "trex") {
+            return trexReader;
         } else if (type == "moof") {
             return recursiveReader;
         } else if (type == "mfhd") {
@@ -389,13 +555,45 @@ namespace {
 }
 
 
-void Mp4Analyzer::parse() {
+void Mp4Analyzer::parse(size_t startOffset) {
     if (!_file.is_open()) {
         throw std::runtime_error("Target file doesn't open");
     }
 
-    auto rootBox = recursiveReader(_file, 0, _length, { _length, "root" });
+    if (startOffset > _length) {
+        throw std::runtime_error("Start offset is beyond the end of file");
+    }
+
+    _file.clear();
+    _file.seekg(startOffset, std::ios_base::beg);
+
+    ReaderContext context { _file, _verbose };
+    _rootBox.reset(recursiveReader(context, startOffset, _length, { _length - startOffset, "root", startOffset, 0 }));
+
+    _parsedLength = startOffset;
+    if (!_rootBox->children.empty()) {
+        auto lastBox = _rootBox->children.back();
+        _parsedLength = lastBox->offset + lastBox->size;
+
+        // a top-level box of size 0 extends to the end of file and keeps growing while it is written
+        BLOCK<4> block4Byte;
+        _file.clear();
+        _file.seekg(lastBox->offset, std::ios_base::beg);
+        _file.read((char*)&block4Byte.data[0], 4);
+        if (_file.gcount() == 4 && bytesToInt<unsigned int>(&block4Byte.data[0]) == 0) {
+            _parsedLength = lastBox->offset;
+        }
+    }
+}
+
+size_t Mp4Analyzer::parsedLength() const {
+    return _parsedLength;
+}
+
+const Mp4Boxes::Box* Mp4Analyzer::rootBox() const {
+    return _rootBox.get();
+}
 
-    /*auto trunBox = (Mp4Boxes::TrunBox*)rootBox->children[0]->children[1]->children[2];
-    auto dataOffset = trunBox->dataOffset;*/
+const std::string& Mp4Analyzer::path() const {
+    return _path;
 }
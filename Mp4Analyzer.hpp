@@ -1,19 +1,40 @@
-
 #pragma once
 
 #include <string>
 #include <fstream>
 #include <functional>
+#include <memory>
+
+namespace Mp4Boxes {
+    struct Box;
+}
 
 class Mp4Analyzer {
 public:
-    Mp4Analyzer();
+    explicit Mp4Analyzer(bool verbose = true);
+    ~Mp4Analyzer();
 
     bool open(const std::string& path);
 
-    void parse();
+    /**
+     * Parses top-level boxes from startOffset to the end of file.
+     * A box that is not written completely yet stops parsing, 
+     * so parsedLength() is where the next call should resume.
+     * A last box of size 0 is parsed up to the end of file but is not counted as complete.
+     */
+    void parse(size_t startOffset = 0);
+
+    size_t parsedLength() const;
+
+    const Mp4Boxes::Box* rootBox() const;
+    const std::string& path() const;
 
 private:
     std::fstream _file;
-    size_t _length;
-};
\ No newline at end of file
+    std::string _path;
+    size_t _length {0};
+    size_t _parsedLength {0};
+    bool _verbose;
+
+    std::unique_ptr<Mp4Boxes::Box> _rootBox;
+};
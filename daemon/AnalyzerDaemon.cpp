@@ -0,0 +1,408 @@
+#include "AnalyzerDaemon.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "../utils/Helpers.hpp"
+
+namespace {
+
+    constexpr size_t MAX_REQUEST_LENGTH = 64 * 1024;
+
+    std::vector<std::string> tokenize(const std::string& request) {
+        std::vector<std::string> tokens;
+        std::istringstream stream(request);
+        std::string token;
+        while (stream >> token) {
+            tokens.push_back(token);
+        }
+        return tokens;
+    }
+
+    unsigned int parseTrackId(const std::string& value) {
+        char* end;
+        auto trackId = strtoul(value.c_str(), &end, 0);
+        if (*end || end == value.c_str()) {
+            throw std::runtime_error("invalid track id " + value);
+        }
+        return static_cast<unsigned int>(trackId);
+    }
+
+    unsigned long int parseTicks(const std::string& value, unsigned int timescale) {
+        char* end;
+        auto seconds = strtod(value.c_str(), &end);
+        if (*end || end == value.c_str() || seconds < 0) {
+            throw std::runtime_error("invalid time " + value);
+        }
+        return static_cast<unsigned long int>(std::llround(seconds * timescale));
+    }
+
+    size_t findTrack(const ParsedFile& file, const std::string& value) {
+        auto trackId = parseTrackId(value);
+        for (size_t i = 0; i < file.movie.tracks.size(); i++) {
+            if (file.movie.tracks[i].trackId == trackId) {
+                return i;
+            }
+        }
+        throw std::runtime_error("no track " + value);
+    }
+
+    void printSample(std::ostringstream& response, size_t index, const Mp4Tracks::Sample& sample) {
+        response << index << " " << sample.decodeTime << " " << sample.compositionTimeOffset << " " <<
+                sample.duration << " " << sample.size << " " << sample.offset << " " <<
+                (sample.isSync() ? "sync" : "-") << "\n";
+    }
+
+    std::string summary(const ParsedFile& file) {
+        std::ostringstream response;
+        response << "path: " << file.path << "\n" <<
+                "length: " << file.length << "\n" <<
+                "boxes: " << file.boxes.size() << "\n" <<
+                "fragments: " << file.movie.fragments.size() << "\n" <<
+                "timescale: " << file.movie.timescale << "\n";
+        for (size_t i = 0; i < file.movie.tracks.size(); i++) {
+            const auto& track = file.movie.tracks[i];
+            response << "track " << track.trackId << ": timescale " << track.timescale <<
+                    ", samples " << file.timelines[i].size() << ", duration " << file.timelines[i].duration() << "\n";
+        }
+        return response.str();
+    }
+
+    std::string find(const ParsedFile& file, const std::string& type) {
+        std::ostringstream response;
+        for (const auto& box : file.boxes) {
+            if (box.type == type) {
+                response << box.type << " " << box.offset << " " << box.size << " " << box.depth << "\n";
+            }
+        }
+        return response.str();
+    }
+
+    std::string seek(const ParsedFile& file, const std::string& trackId, const std::string& time) {
+        auto trackIndex = findTrack(file, trackId);
+        const auto& timeline = file.timelines[trackIndex];
+        auto index = timeline.upperBound(parseTicks(time, file.movie.tracks[trackIndex].timescale));
+
+        // the last sync sample that starts at or before the requested time, searched a block at a time
+        constexpr auto blockSize = Mp4Tracks::CompactSamples::BLOCK_SIZE;
+        bool found = false;
+        Mp4Tracks::Sample sample;
+        size_t sampleIndex = 0;
+        while (index > 0 && !found) {
+            auto blockStart = (index - 1) / blockSize * blockSize;
+            timeline.forEach(blockStart, index, [&](size_t i, const Mp4Tracks::Sample& candidate) {
+                if (candidate.isSync()) {
+                    found = true;
+                    sample = candidate;
+                    sampleIndex = i;
+                }
+            });
+            index = blockStart;
+        }
+        if (!found) {
+            throw std::runtime_error("no sync sample before " + time);
+        }
+
+        std::ostringstream response;
+        printSample(response, sampleIndex, sample);
+
+        if (sample.fragmentIndex < file.movie.fragments.size()) {
+            const auto& fragment = file.movie.fragments[sample.fragmentIndex];
+            response << "fragment " << fragment.sequenceNumber << " " << fragment.offset << " " << fragment.size << "\n";
+        }
+        return response.str();
+    }
+
+    std::string samples(const ParsedFile& file, const std::string& trackId, const std::string& start, const std::string& end) {
+        auto trackIndex = findTrack(file, trackId);
+        const auto& timeline = file.timelines[trackIndex];
+        auto timescale = file.movie.tracks[trackIndex].timescale;
+        auto startTicks = parseTicks(start, timescale);
+        auto endTicks = parseTicks(end, timescale);
+
+        auto first = timeline.upperBound(startTicks);
+        if (first > 0) {
+            auto previous = timeline.at(first - 1);
+            if (previous.decodeTime + previous.duration > startTicks) {
+                first--;
+            }
+        }
+        // samples that start before the end
+        auto last = endTicks > 0 ? timeline.upperBound(endTicks - 1) : 0;
+
+        std::ostringstream response;
+        timeline.forEach(first, last, [&response](size_t index, const Mp4Tracks::Sample& sample) {
+            printSample(response, index, sample);
+        });
+        return response.str();
+    }
+
+}
+
+AnalyzerDaemon::AnalyzerDaemon(
+        const std::string& socketPath,
+        size_t cacheMemoryLimit,
+        unsigned int workers,
+        bool compactTimelines)
+    : _socketPath{socketPath},
+    _cache{cacheMemoryLimit, compactTimelines} {
+    sockaddr_un address {};
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Socket path is too long");
+    }
+    std::strcpy(address.sun_path, socketPath.c_str());
+
+    // a socket left by a previous run is replaced, anything else at that path is kept
+    struct stat info;
+    if (lstat(socketPath.c_str(), &info) == 0) {
+        if (!S_ISSOCK(info.st_mode)) {
+            throw std::runtime_error(socketPath + " exists and is not a socket");
+        }
+        unlink(socketPath.c_str());
+    }
+
+    _socketFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (_socketFd < 0) {
+        throw Helpers::systemError("Unable to create socket");
+    }
+
+    if (bind(_socketFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+            listen(_socketFd, SOMAXCONN) != 0) {
+        auto error = Helpers::systemError("Unable to listen on " + socketPath);
+        close(_socketFd);
+        throw error;
+    }
+
+    _epollFd = epoll_create1(EPOLL_CLOEXEC);
+    epoll_event event {};
+    event.events = EPOLLIN;
+    event.data.fd = _socketFd;
+    if (_epollFd < 0 || epoll_ctl(_epollFd, EPOLL_CTL_ADD, _socketFd, &event) != 0) {
+        auto error = Helpers::systemError("Unable to poll " + socketPath);
+        if (_epollFd >= 0) {
+            close(_epollFd);
+        }
+        close(_socketFd);
+        unlink(socketPath.c_str());
+        throw error;
+    }
+
+    for (unsigned int i = 0; i < std::max(workers, 1u); i++) {
+        _workers.emplace_back(&AnalyzerDaemon::worker, this);
+    }
+}
+
+AnalyzerDaemon::~AnalyzerDaemon() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopped = true;
+    }
+    _condition.notify_all();
+    for (auto& worker : _workers) {
+        worker.join();
+    }
+
+    for (const auto& client : _clients) {
+        close(client.first);
+    }
+
+    close(_epollFd);
+    close(_socketFd);
+    unlink(_socketPath.c_str());
+}
+
+void AnalyzerDaemon::run() {
+    std::array<epoll_event, 64> events;
+
+    while (true) {
+        auto count = epoll_wait(_epollFd, events.data(), static_cast<int>(events.size()), -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw Helpers::systemError("Unable to poll clients");
+        }
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (int i = 0; i < count; i++) {
+            if (events[i].data.fd == _socketFd) {
+                accept();
+            } else {
+                // one shot events keep a client with a single worker until it is rearmed
+                _readyClients.push(events[i].data.fd);
+                _condition.notify_one();
+            }
+        }
+    }
+}
+
+void AnalyzerDaemon::accept() {
+    while (true) {
+        auto clientFd = accept4(_socketFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (clientFd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return;
+            }
+            throw Helpers::systemError("Unable to accept client");
+        }
+
+        epoll_event event {};
+        event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+        event.data.fd = clientFd;
+        if (epoll_ctl(_epollFd, EPOLL_CTL_ADD, clientFd, &event) != 0) {
+            close(clientFd);
+            continue;
+        }
+        _clients[clientFd].fd = clientFd;
+    }
+}
+
+void AnalyzerDaemon::worker() {
+    while (true) {
+        Client* client;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _condition.wait(lock, [this]() { return _stopped || !_readyClients.empty(); });
+            if (_stopped) {
+                return;
+            }
+            client = &_clients.at(_readyClients.front());
+            _readyClients.pop();
+        }
+
+        bool connected;
+        try {
+            connected = serve(*client);
+        } catch (const std::exception&) {
+            // client went away in the middle of a response
+            connected = false;
+        }
+
+        if (connected) {
+            // a client that does not read its responses waits for EPOLLOUT without holding a worker
+            epoll_event event {};
+            event.events = (client->outgoing.empty() ? EPOLLIN : EPOLLOUT) | EPOLLRDHUP | EPOLLONESHOT;
+            event.data.fd = client->fd;
+            if (epoll_ctl(_epollFd, EPOLL_CTL_MOD, client->fd, &event) == 0) {
+                continue;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        close(client->fd);
+        _clients.erase(client->fd);
+    }
+}
+
+bool AnalyzerDaemon::serve(Client& client) {
+    // nothing new is read while earlier responses are still queued
+    if (!flush(client)) {
+        return false;
+    }
+    if (!client.outgoing.empty()) {
+        return true;
+    }
+
+    char buffer[4096];
+
+    while (true) {
+        auto length = read(client.fd, buffer, sizeof(buffer));
+        if (length < 0 && errno == EINTR) {
+            continue;
+        }
+        if (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return true;
+        }
+        if (length <= 0) {
+            return false;
+        }
+        client.pending.append(buffer, length);
+
+        size_t lineEnd;
+        while ((lineEnd = client.pending.find('\n')) != std::string::npos) {
+            auto request = client.pending.substr(0, lineEnd);
+            client.pending.erase(0, lineEnd + 1);
+
+            if (client.discarding) {
+                client.discarding = false;
+                client.outgoing += "error: request too long\n\n";
+            } else {
+                client.outgoing += handle(request) + "\n";
+            }
+        }
+
+        if (client.pending.size() > MAX_REQUEST_LENGTH) {
+            // the rest of the line is dropped and answered with an error once it ends
+            client.pending.clear();
+            client.discarding = true;
+        }
+
+        if (!flush(client)) {
+            return false;
+        }
+        if (!client.outgoing.empty()) {
+            return true;
+        }
+    }
+}
+
+bool AnalyzerDaemon::flush(Client& client) {
+    while (client.sent < client.outgoing.size()) {
+        // a client that disconnects early must not kill the daemon with SIGPIPE
+        auto length = send(client.fd, client.outgoing.data() + client.sent,
+                client.outgoing.size() - client.sent, MSG_NOSIGNAL);
+        if (length < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        client.sent += length;
+    }
+
+    client.outgoing.clear();
+    client.sent = 0;
+    return true;
+}
+
+std::string AnalyzerDaemon::handle(const std::string& request) {
+    auto tokens = tokenize(request);
+    if (tokens.empty()) {
+        return "error: empty request\n";
+    }
+
+    const auto& command = tokens[0];
+
+    try {
+        if (command == "stats" && tokens.size() == 1) {
+            return _cache.statistics().toString();
+        } else if (command == "summary" && tokens.size() == 2) {
+            return summary(*_cache.get(tokens[1]));
+        } else if (command == "find" && tokens.size() == 3) {
+            return find(*_cache.get(tokens[1]), tokens[2]);
+        } else if (command == "seek" && tokens.size() == 4) {
+            return seek(*_cache.get(tokens[1]), tokens[2], tokens[3]);
+        } else if (command == "samples" && tokens.size() == 5) {
+            return samples(*_cache.get(tokens[1]), tokens[2], tokens[3], tokens[4]);
+        }
+    } catch (const std::exception& e) {
+        return std::string("error: ") + e.what() + "\n";
+    }
+
+    return "error: unknown request " + request + "\n";
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ParsedFileCache.hpp"
+
+/**
+ * Serves queries about mp4 files over a Unix domain socket.
+ *
+ * Every request is a single line of at most 64 KiB, every response ends with an empty line:
+ *   summary $path
+ *   find $path $type
+ *   seek $path $trackId $seconds
+ *   samples $path $trackId $startSeconds $endSeconds
+ *   stats
+ */
+class AnalyzerDaemon {
+public:
+    AnalyzerDaemon(
+                const std::string& socketPath,
+                size_t cacheMemoryLimit,
+                unsigned int workers,
+                bool compactTimelines = false);
+    ~AnalyzerDaemon();
+
+    AnalyzerDaemon(const AnalyzerDaemon&) = delete;
+    AnalyzerDaemon& operator=(const AnalyzerDaemon&) = delete;
+
+    /**
+     * Accepts clients and dispatches their requests to workers until an error occurs
+     */
+    void run();
+
+private:
+    struct Client {
+        int fd {-1};
+        std::string pending;
+        std::string outgoing;
+        size_t sent {0};
+        bool discarding {false};
+    };
+
+    void accept();
+    void worker();
+
+    /**
+     * Answers every complete request that has arrived so far
+     * @return false when the client has disconnected
+     */
+    bool serve(Client& client);
+
+    /**
+     * Sends as much of the queued responses as the socket accepts without blocking
+     * @return false when the client has disconnected
+     */
+    bool flush(Client& client);
+    std::string handle(const std::string& request);
+
+    std::string _socketPath;
+    int _socketFd {-1};
+    int _epollFd {-1};
+    ParsedFileCache _cache;
+
+    /**
+     * Clients are polled by run(), a worker only takes a client that has data to read
+     * or room for its queued responses, so idle connections never hold a worker
+     */
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    std::map<int, Client> _clients;
+    std::queue<int> _readyClients;
+    bool _stopped {false};
+    std::vector<std::thread> _workers;
+};
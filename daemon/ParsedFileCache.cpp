@@ -0,0 +1,218 @@
+#include "ParsedFileCache.hpp"
+
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include <sys/stat.h>
+
+#include "../Mp4Analyzer.hpp"
+#include "../models/Mp4Boxes.hpp"
+
+namespace {
+
+    struct FileState {
+        std::string path;
+        size_t length {0};
+        long int modificationSeconds {0};
+        long int modificationNanoseconds {0};
+    };
+
+    FileState fileState(const std::string& path) {
+        char resolved[PATH_MAX];
+        if (!realpath(path.c_str(), resolved)) {
+            throw std::runtime_error("Unable to resolve " + path + ": " + std::strerror(errno));
+        }
+
+        struct stat info;
+        if (stat(resolved, &info) != 0 || !S_ISREG(info.st_mode)) {
+            throw std::runtime_error(path + " is not a regular file");
+        }
+
+        return { resolved, static_cast<size_t>(info.st_size), info.st_mtim.tv_sec, info.st_mtim.tv_nsec };
+    }
+
+    bool isSameState(const ParsedFile& file, const FileState& state) {
+        return file.length == state.length &&
+                file.modificationSeconds == state.modificationSeconds &&
+                file.modificationNanoseconds == state.modificationNanoseconds;
+    }
+
+    void flatten(const Mp4Boxes::Box& box, unsigned int depth, std::vector<ParsedFile::BoxEntry>& boxes) {
+        for (auto child : box.children) {
+            boxes.push_back({ child->type, child->offset, child->size, depth });
+            flatten(*child, depth + 1, boxes);
+        }
+    }
+
+    std::shared_ptr<const ParsedFile> load(const FileState& state, bool compactTimelines) {
+        Mp4Analyzer analyzer(false);
+        if (!analyzer.open(state.path)) {
+            throw std::runtime_error("Unable to open file " + state.path);
+        }
+        analyzer.parse();
+
+        auto file = std::make_shared<ParsedFile>();
+        file->path = state.path;
+        file->length = state.length;
+        file->modificationSeconds = state.modificationSeconds;
+        file->modificationNanoseconds = state.modificationNanoseconds;
+
+        flatten(*analyzer.rootBox(), 0, file->boxes);
+        file->movie = Mp4Tracks::collect(*analyzer.rootBox());
+        for (auto& track : file->movie.tracks) {
+            file->timelines.emplace_back(std::move(track.samples), compactTimelines);
+            track.samples = std::vector<Mp4Tracks::Sample>();
+        }
+
+        return file;
+    }
+
+}
+
+Timeline::Timeline(std::vector<Mp4Tracks::Sample> samples, bool compact) {
+    if (!samples.empty()) {
+        _duration = samples.back().decodeTime + samples.back().duration - samples.front().decodeTime;
+    }
+    if (compact) {
+        _compact.reset(new Mp4Tracks::CompactSamples(samples));
+    } else {
+        _samples = std::move(samples);
+    }
+}
+
+size_t Timeline::size() const noexcept {
+    return _compact ? _compact->size() : _samples.size();
+}
+
+unsigned long int Timeline::duration() const noexcept {
+    return _duration;
+}
+
+size_t Timeline::memoryUsage() const noexcept {
+    return sizeof(Timeline) + (_compact ? _compact->memoryUsage() : _samples.capacity() * sizeof(Mp4Tracks::Sample));
+}
+
+Mp4Tracks::Sample Timeline::at(size_t index) const {
+    return _compact ? _compact->at(index) : _samples.at(index);
+}
+
+size_t Timeline::upperBound(unsigned long int decodeTime) const {
+    if (_compact) {
+        return _compact->upperBound(decodeTime);
+    }
+
+    auto it = std::upper_bound(
+        _samples.cbegin(),
+        _samples.cend(),
+        decodeTime,
+        [](unsigned long int value, const Mp4Tracks::Sample& sample) {
+            return value < sample.decodeTime;
+        }
+    );
+    return it - _samples.cbegin();
+}
+
+size_t ParsedFile::memoryUsage() const noexcept {
+    auto usage = sizeof(ParsedFile) + path.capacity() + boxes.capacity() * sizeof(BoxEntry);
+    usage += movie.fragments.capacity() * sizeof(Mp4Tracks::Fragment);
+    usage += movie.mediaData.capacity() * sizeof(Mp4Tracks::MediaData);
+    usage += movie.tracks.capacity() * sizeof(Mp4Tracks::Track);
+    for (const auto& timeline : timelines) {
+        usage += timeline.memoryUsage();
+    }
+    return usage;
+}
+
+std::string ParsedFileCache::Statistics::toString() const noexcept {
+    return "hits: " + std::to_string(hits) +
+        "\nmisses: " + std::to_string(misses) +
+        "\nentries: " + std::to_string(entries) +
+        "\nmemory: " + std::to_string(memoryUsage) + "/" + std::to_string(memoryLimit) +
+        "\ntimelines: " + (compactTimelines ? "compact" : "plain") + "\n";
+}
+
+ParsedFileCache::ParsedFileCache(size_t memoryLimit, bool compactTimelines)
+    : _memoryLimit{memoryLimit},
+    _compactTimelines{compactTimelines} {}
+
+std::shared_ptr<const ParsedFile> ParsedFileCache::get(const std::string& path) {
+    auto state = fileState(path);
+
+    std::promise<Entry> promise;
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+
+        auto cached = _entries.find(state.path);
+        if (cached != _entries.end()) {
+            if (isSameState(**cached->second, state)) {
+                _hits++;
+                _lru.splice(_lru.begin(), _lru, cached->second);
+                return *cached->second;
+            }
+            _memoryUsage -= (*cached->second)->memoryUsage();
+            _lru.erase(cached->second);
+            _entries.erase(cached);
+        }
+
+        auto loading = _loading.find(state.path);
+        if (loading != _loading.end()) {
+            auto future = loading->second;
+            lock.unlock();
+            return future.get();
+        }
+
+        _misses++;
+        _loading.emplace(state.path, promise.get_future().share());
+    }
+
+    Entry entry;
+    try {
+        entry = load(state, _compactTimelines);
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        promise.set_exception(std::current_exception());
+        _loading.erase(state.path);
+        throw;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    insert(entry);
+    promise.set_value(entry);
+    _loading.erase(state.path);
+    return entry;
+}
+
+ParsedFileCache::Statistics ParsedFileCache::statistics() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    Statistics statistics;
+    statistics.hits = _hits;
+    statistics.misses = _misses;
+    statistics.entries = _entries.size();
+    statistics.memoryUsage = _memoryUsage;
+    statistics.memoryLimit = _memoryLimit;
+    statistics.compactTimelines = _compactTimelines;
+    return statistics;
+}
+
+void ParsedFileCache::insert(const Entry& entry) {
+    auto usage = entry->memoryUsage();
+    if (usage > _memoryLimit) {
+        // served once, but never pushes out everything else
+        return;
+    }
+
+    while (!_lru.empty() && _memoryUsage + usage > _memoryLimit) {
+        const auto& oldest = _lru.back();
+        _memoryUsage -= oldest->memoryUsage();
+        _entries.erase(oldest->path);
+        _lru.pop_back();
+    }
+
+    _lru.push_front(entry);
+    _entries[entry->path] = _lru.begin();
+    _memoryUsage += usage;
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <algorithm>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../models/CompactSamples.hpp"
+#include "../models/Mp4Tracks.hpp"
+
+/**
+ * Samples of one track, kept as a plain vector or in Mp4Tracks::CompactSamples
+ */
+class Timeline {
+public:
+    Timeline(std::vector<Mp4Tracks::Sample> samples, bool compact);
+
+    size_t size() const noexcept;
+    unsigned long int duration() const noexcept;
+    size_t memoryUsage() const noexcept;
+
+    Mp4Tracks::Sample at(size_t index) const;
+
+    /**
+     * Index of the first sample with decode time after decodeTime
+     */
+    size_t upperBound(unsigned long int decodeTime) const;
+
+    /**
+     * Calls function(index, sample) for samples [first, last), compact blocks are decoded once
+     */
+    template<typename Function>
+    void forEach(size_t first, size_t last, Function function) const {
+        last = std::min(last, size());
+        if (!_compact) {
+            for (auto i = first; i < last; i++) {
+                function(i, _samples[i]);
+            }
+            return;
+        }
+
+        constexpr auto blockSize = Mp4Tracks::CompactSamples::BLOCK_SIZE;
+        std::vector<Mp4Tracks::Sample> decoded;
+        for (auto block = first / blockSize; block * blockSize < last; block++) {
+            _compact->decodeBlock(block, decoded);
+            auto blockStart = block * blockSize;
+            for (auto i = std::max(first, blockStart); i < std::min(last, blockStart + decoded.size()); i++) {
+                function(i, decoded[i - blockStart]);
+            }
+        }
+    }
+
+private:
+    std::vector<Mp4Tracks::Sample> _samples;
+    std::unique_ptr<Mp4Tracks::CompactSamples> _compact;
+    unsigned long int _duration {0};
+};
+
+/**
+ * Everything the daemon answers from: flattened box tree and sample timelines
+ */
+struct ParsedFile {
+    struct BoxEntry {
+        std::string type;
+        unsigned long int offset {0};
+        unsigned long int size {0};
+        unsigned int depth {0};
+    };
+
+    std::string path;
+    size_t length {0};
+    long int modificationSeconds {0};
+    long int modificationNanoseconds {0};
+
+    std::vector<BoxEntry> boxes;
+
+    /**
+     * Samples of movie tracks are moved to timelines, one per track in the same order
+     */
+    Mp4Tracks::Movie movie;
+    std::vector<Timeline> timelines;
+
+    size_t memoryUsage() const noexcept;
+};
+
+/**
+ * LRU cache of parsed files bounded by their estimated memory usage.
+ * An entry is valid while size and mtime of the file stay the same.
+ * Misses are parsed by the calling thread, concurrent requests for
+ * the same file wait for a single parse.
+ */
+class ParsedFileCache {
+public:
+    struct Statistics {
+        unsigned long int hits {0};
+        unsigned long int misses {0};
+        size_t entries {0};
+        size_t memoryUsage {0};
+        size_t memoryLimit {0};
+        bool compactTimelines {false};
+
+        std::string toString() const noexcept;
+    };
+
+    /**
+     * Compact timelines trade slower sample lookups for several times less memory per entry
+     */
+    explicit ParsedFileCache(size_t memoryLimit, bool compactTimelines = false);
+
+    std::shared_ptr<const ParsedFile> get(const std::string& path);
+
+    Statistics statistics() const;
+
+private:
+    using Entry = std::shared_ptr<const ParsedFile>;
+    using LruList = std::list<Entry>;
+
+    void insert(const Entry& entry);
+
+    size_t _memoryLimit;
+    bool _compactTimelines;
+    size_t _memoryUsage {0};
+    unsigned long int _hits {0};
+    unsigned long int _misses {0};
+
+    mutable std::mutex _mutex;
+    LruList _lru;
+    std::unordered_map<std::string, LruList::iterator> _entries;
+    std::unordered_map<std::string, std::shared_future<Entry>> _loading;
+};
@@ -0,0 +1,78 @@
+#include "FingerprintStore.hpp"
+
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+FingerprintStore::FingerprintStore(const std::string& storePath)
+    : _storePath{storePath} {
+    std::ifstream store(storePath);
+    if (!store.is_open()) {
+        // first run, the store is created on save
+        return;
+    }
+
+    std::string line;
+    while (std::getline(store, line)) {
+        std::istringstream stream(line);
+        uint64_t fingerprint;
+        Origin origin;
+        if (!(stream >> std::hex >> fingerprint >> std::dec >> origin.offset >> origin.sequenceNumber) ||
+                !std::getline(stream >> std::ws, origin.path)) {
+            continue;
+        }
+        _origins.emplace(fingerprint, origin);
+    }
+}
+
+const FingerprintStore::Origin* FingerprintStore::check(
+        uint64_t fingerprint, const std::string& path, unsigned long int offset, unsigned int sequenceNumber) {
+    const auto& canonical = canonicalPath(path);
+
+    auto inserted = _origins.emplace(fingerprint, Origin{ canonical, offset, sequenceNumber });
+    if (inserted.second) {
+        _added.push_back(fingerprint);
+        return nullptr;
+    }
+
+    const auto& origin = inserted.first->second;
+    if (origin.path == canonical && origin.offset == offset) {
+        return nullptr;
+    }
+    return &origin;
+}
+
+void FingerprintStore::save() {
+    if (_added.empty()) {
+        return;
+    }
+
+    std::ofstream store(_storePath, std::ios_base::app);
+    if (!store.is_open()) {
+        throw std::runtime_error("Unable to write fingerprint store " + _storePath);
+    }
+
+    for (auto fingerprint : _added) {
+        const auto& origin = _origins[fingerprint];
+        store << std::hex << fingerprint << std::dec << " " << origin.offset << " " <<
+                origin.sequenceNumber << " " << origin.path << "\n";
+    }
+    _added.clear();
+}
+
+const std::string& FingerprintStore::canonicalPath(const std::string& path) {
+    // every fragment of a file is checked in a row
+    if (path != _lastPath || _lastCanonicalPath.empty()) {
+        char resolved[PATH_MAX];
+        if (!realpath(path.c_str(), resolved)) {
+            throw std::runtime_error("Unable to resolve " + path + ": " + std::strerror(errno));
+        }
+        _lastPath = path;
+        _lastCanonicalPath = resolved;
+    }
+    return _lastCanonicalPath;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Persistent map from fragment fingerprint to the first fragment seen with it.
+ * Stored as text lines "fingerprint offset sequence path", new fragments are appended.
+ * A fragment is identified by the canonical path of its file and the offset of its moof,
+ * so a fragment re-sent with the same sequence number is still reported.
+ */
+class FingerprintStore {
+public:
+    struct Origin {
+        std::string path;
+        unsigned long int offset {0};
+        unsigned int sequenceNumber {0};
+    };
+
+    explicit FingerprintStore(const std::string& storePath);
+
+    /**
+     * @return origin of another fragment with the same fingerprint,
+     * nullptr if the fragment is new (it is remembered then) or was checked before
+     */
+    const Origin* check(uint64_t fingerprint, const std::string& path, unsigned long int offset, unsigned int sequenceNumber);
+
+    /**
+     * Appends fragments remembered since the last save to the store file
+     */
+    void save();
+
+private:
+    const std::string& canonicalPath(const std::string& path);
+
+    std::string _storePath;
+    std::unordered_map<uint64_t, Origin> _origins;
+    std::vector<uint64_t> _added;
+
+    std::string _lastPath;
+    std::string _lastCanonicalPath;
+};
@@ -0,0 +1,155 @@
+#include "FragmentHasher.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+#include "../utils/MappedFile.hpp"
+#include "../utils/XxHash64.hpp"
+
+namespace {
+
+    std::string toHex(uint64_t value) {
+        char buffer[17];
+        std::snprintf(buffer, sizeof(buffer), "%016llx", static_cast<unsigned long long>(value));
+        return buffer;
+    }
+
+    void hashRun(const MappedFile& file, const Mp4Tracks::Track& track, FragmentHasher::RunHash& run) {
+        XxHash64 state;
+
+        auto rangeStart = track.samples[run.firstSample].offset;
+        auto rangeEnd = rangeStart;
+
+        for (auto i = run.firstSample; i < run.lastSample; i++) {
+            const auto& sample = track.samples[i];
+            if (sample.offset + sample.size > file.size()) {
+                run.complete = false;
+                return;
+            }
+            if (sample.offset != rangeEnd) {
+                state.update(file.data() + rangeStart, rangeEnd - rangeStart);
+                rangeStart = sample.offset;
+            }
+            rangeEnd = sample.offset + sample.size;
+        }
+        state.update(file.data() + rangeStart, rangeEnd - rangeStart);
+
+        run.bytes = 0;
+        for (auto i = run.firstSample; i < run.lastSample; i++) {
+            run.bytes += track.samples[i].size;
+        }
+        run.hash = state.digest();
+    }
+
+    void hashFragment(
+                const MappedFile& file,
+                const Mp4Tracks::Movie& movie,
+                FragmentHasher::FragmentHash& fragment) {
+        XxHash64 fingerprint;
+
+        for (auto& run : fragment.runs) {
+            auto track = std::find_if(movie.tracks.cbegin(), movie.tracks.cend(), [&run](const Mp4Tracks::Track& track) {
+                return track.trackId == run.trackId;
+            });
+            hashRun(file, *track, run);
+            if (!run.complete) {
+                fragment.complete = false;
+                continue;
+            }
+
+            uint8_t record[20];
+            for (int i = 0; i < 4; i++) {
+                record[i] = static_cast<uint8_t>(run.trackId >> (24 - 8 * i));
+            }
+            for (int i = 0; i < 8; i++) {
+                record[4 + i] = static_cast<uint8_t>(run.bytes >> (56 - 8 * i));
+                record[12 + i] = static_cast<uint8_t>(run.hash >> (56 - 8 * i));
+            }
+            fingerprint.update(record, sizeof(record));
+
+            fragment.bytes += run.bytes;
+        }
+
+        if (fragment.complete) {
+            fragment.fingerprint = fingerprint.digest();
+        }
+    }
+
+}
+
+std::string FragmentHasher::FragmentHash::toString() const noexcept {
+    auto str = "fragment " + std::to_string(sequenceNumber) +
+        " ->\r\n\r\toffset: " + std::to_string(offset) +
+        "\r\n\r\tpayload bytes: " + std::to_string(bytes) +
+        "\r\n\r\tfingerprint: " + (complete ? toHex(fingerprint) : "none, fragment is incomplete") + "\r\n";
+    for (const auto& run : runs) {
+        str += "\r\ttrack " + std::to_string(run.trackId) +
+            " samples " + std::to_string(run.firstSample) + "-" + std::to_string(run.lastSample - 1) + ": " +
+            (run.complete ? std::to_string(run.bytes) + " bytes, xxh64 " + toHex(run.hash) : "past the end of the file") +
+            "\r\n";
+    }
+    return str;
+}
+
+std::vector<FragmentHasher::FragmentHash> FragmentHasher::hashFragments(
+        const std::string& path,
+        const Mp4Tracks::Movie& movie,
+        unsigned int threads) {
+    std::vector<FragmentHash> fragments(movie.fragments.size());
+    for (size_t i = 0; i < fragments.size(); i++) {
+        fragments[i].sequenceNumber = movie.fragments[i].sequenceNumber;
+        fragments[i].offset = movie.fragments[i].offset;
+    }
+
+    for (const auto& track : movie.tracks) {
+        for (size_t i = 0; i < track.samples.size(); ) {
+            auto fragmentIndex = track.samples[i].fragmentIndex;
+            RunHash run;
+            run.trackId = track.trackId;
+            run.firstSample = i;
+            while (i < track.samples.size() && track.samples[i].fragmentIndex == fragmentIndex) {
+                i++;
+            }
+            run.lastSample = i;
+            fragments[fragmentIndex].runs.push_back(run);
+        }
+    }
+
+    MappedFile file(path);
+
+    std::atomic<size_t> nextFragment {0};
+    std::exception_ptr failure;
+    std::mutex failureMutex;
+
+    auto worker = [&]() {
+        try {
+            size_t index;
+            while ((index = nextFragment++) < fragments.size()) {
+                hashFragment(file, movie, fragments[index]);
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(failureMutex);
+            failure = std::current_exception();
+            nextFragment = fragments.size();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned int i = 1; i < std::max(threads, 1u); i++) {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : workers) {
+        thread.join();
+    }
+
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+
+    return fragments;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../models/Mp4Tracks.hpp"
+
+namespace FragmentHasher {
+
+    /**
+     * Samples of one track inside one fragment
+     */
+    struct RunHash {
+        unsigned int trackId {0};
+        size_t firstSample {0};
+        size_t lastSample {0};
+        unsigned long int bytes {0};
+        uint64_t hash {0};
+
+        /**
+         * False when a sample lies past the end of the file, the run then has no hash
+         */
+        bool complete {true};
+    };
+
+    struct FragmentHash {
+        unsigned int sequenceNumber {0};
+        unsigned long int offset {0};
+        unsigned long int bytes {0};
+
+        /**
+         * Combines run hashes with their track ids and lengths,
+         * equal for fragments that carry the same payload
+         */
+        uint64_t fingerprint {0};
+        std::vector<RunHash> runs;
+
+        /**
+         * False when some run is incomplete (the file was cut short),
+         * such a fragment has no fingerprint and must not be compared
+         */
+        bool complete {true};
+
+        std::string toString() const noexcept;
+    };
+
+    /**
+     * Hashes the payload of every fragment with XXH64, fragments are spread over threads.
+     * Samples are read from a memory mapping of the file, adjacent samples are hashed as one range.
+     * Fragments with samples past the end of the file are marked incomplete, the rest are still hashed.
+     */
+    std::vector<FragmentHash> hashFragments(
+                const std::string& path,
+                const Mp4Tracks::Movie& movie,
+                unsigned int threads);
+}
@@ -1,8 +1,19 @@
 
+#include <chrono>
 #include <iostream>
+#include <thread>
 
 #include "utils/CliParser.hpp"
 #include "Mp4Analyzer.hpp"
+#include "daemon/AnalyzerDaemon.hpp"
+#include "fingerprint/FingerprintStore.hpp"
+#include "fingerprint/FragmentHasher.hpp"
+#include "models/CompactSamples.hpp"
+#include "models/Mp4Tracks.hpp"
+#include "models/SampleDecoders.hpp"
+#include "remux/Defragmenter.hpp"
+#include "remux/Segmenter.hpp"
+#include "watch/FileWatcher.hpp"
 
 int main(int argc, char *argv[]) {
     std::cout << "Hello, world!" << std::endl;
@@ -20,14 +31,122 @@ int main(int argc, char *argv[]) {
             static_cast<int>(settings->levelOfDetails) << " " <<
             settings->tempVarForCheck << std::endl;
     
-    auto mp4Analyzer = std::make_unique<Mp4Analyzer>();
+    if (!settings->watchPaths.empty()) {
+        try {
+            FileWatcher watcher;
+            for (const auto& path : settings->watchPaths) {
+                watcher.add(path);
+            }
+            watcher.run();
+        } catch (const std::exception& e) {
+            std::cout << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    if (!settings->daemonSocket.empty()) {
+        try {
+            auto workers = settings->workers ? settings->workers : std::thread::hardware_concurrency();
+            AnalyzerDaemon daemon(
+                settings->daemonSocket,
+                static_cast<size_t>(settings->cacheMegabytes) << 20,
+                static_cast<unsigned int>(workers),
+                settings->compact);
+            daemon.run();
+        } catch (const std::exception& e) {
+            std::cout << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    if (settings->benchmarkSamples > 0) {
+        try {
+            std::cout << SampleDecoders::benchmark(static_cast<size_t>(settings->benchmarkSamples)) << std::endl;
+        } catch (const std::exception& e) {
+            std::cout << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    bool fingerprint = settings->checksum || !settings->fingerprintStore.empty();
+    bool quiet = !settings->defragmentPath.empty() || !settings->segmentPrefix.empty() || fingerprint || settings->compact;
+    auto mp4Analyzer = std::make_unique<Mp4Analyzer>(!quiet);
     
     if (!mp4Analyzer->open(settings->path)) {
         std::cout << "Unable to open file " << settings->path << std::endl;
         return 1;
     }
 
-    mp4Analyzer->parse();
+    try {
+        mp4Analyzer->parse();
+
+        if (!settings->defragmentPath.empty()) {
+            auto statistics = Defragmenter::defragment(*mp4Analyzer, settings->defragmentPath);
+            std::cout << statistics.toString() << std::endl;
+        } else if (!settings->segmentPrefix.empty()) {
+            Segmenter::Options options;
+            options.start = settings->rangeStart;
+            options.end = settings->rangeEnd;
+            options.segmentDuration = settings->segmentDuration;
+            options.outputPrefix = settings->segmentPrefix;
+
+            auto statistics = Segmenter::segment(*mp4Analyzer, options);
+            std::cout << statistics.toString() << std::endl;
+        } else if (fingerprint) {
+            auto movie = Mp4Tracks::collect(*mp4Analyzer->rootBox());
+            auto threads = settings->workers ? settings->workers : std::thread::hardware_concurrency();
+
+            auto start = std::chrono::steady_clock::now();
+            auto fragments = FragmentHasher::hashFragments(mp4Analyzer->path(), movie, threads);
+            auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            unsigned long int bytes = 0;
+            for (const auto& fragment : fragments) {
+                bytes += fragment.bytes;
+                if (settings->checksum) {
+                    std::cout << fragment.toString() << std::endl;
+                }
+            }
+
+            std::cout << "hashed " << bytes << " bytes of " << fragments.size() << " fragments in " <<
+                    elapsed * 1000 << " ms (" << (elapsed > 0 ? bytes / elapsed / (1 << 20) : 0) << " MiB/s)" << std::endl;
+
+            if (!settings->fingerprintStore.empty()) {
+                FingerprintStore store(settings->fingerprintStore);
+                for (const auto& fragment : fragments) {
+                    if (fragment.runs.empty()) {
+                        continue;
+                    }
+                    if (!fragment.complete) {
+                        // a truncated fragment is neither recorded nor compared
+                        std::cout << "incomplete: fragment " << fragment.sequenceNumber << " at offset " <<
+                                fragment.offset << " is cut short, not fingerprinted" << std::endl;
+                        continue;
+                    }
+                    auto origin = store.check(
+                            fragment.fingerprint, mp4Analyzer->path(), fragment.offset, fragment.sequenceNumber);
+                    if (origin) {
+                        std::cout << "duplicate: fragment " << fragment.sequenceNumber << " at offset " << fragment.offset <<
+                                " repeats fragment " << origin->sequenceNumber << " at offset " << origin->offset <<
+                                " of " << origin->path << std::endl;
+                    }
+                }
+                store.save();
+            }
+        } else if (settings->compact) {
+            auto movie = Mp4Tracks::collect(*mp4Analyzer->rootBox());
+            for (const auto& track : movie.tracks) {
+                std::cout << "track " << track.trackId << " ->\r\n" <<
+                        Mp4Tracks::CompactSamples::compare(track.samples).toString() << std::endl;
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cout << "Error: " << e.what() << std::endl;
+        return 1;
+    }
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,256 @@
+#include "CompactSamples.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <stdexcept>
+
+namespace {
+
+    inline void writeVarint(std::vector<uint8_t>& data, uint64_t value) {
+        while (value >= 0x80) {
+            data.push_back(static_cast<uint8_t>(value) | 0x80);
+            value >>= 7;
+        }
+        data.push_back(static_cast<uint8_t>(value));
+    }
+
+    inline uint64_t readVarint(const uint8_t*& data) {
+        uint64_t value = *data & 0x7f;
+        int shift = 7;
+        while (*data++ & 0x80) {
+            value |= static_cast<uint64_t>(*data & 0x7f) << shift;
+            shift += 7;
+        }
+        return value;
+    }
+
+    inline uint64_t zigzag(int64_t value) {
+        return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+    }
+
+    inline int64_t unzigzag(uint64_t value) {
+        return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
+
+    /**
+     * Run-length encodes values as (run length, value) varint pairs
+     */
+    template<typename Getter>
+    void writeRuns(std::vector<uint8_t>& data, size_t count, Getter value) {
+        size_t i = 0;
+        while (i < count) {
+            auto runValue = value(i);
+            size_t runEnd = i + 1;
+            while (runEnd < count && value(runEnd) == runValue) {
+                runEnd++;
+            }
+            writeVarint(data, runEnd - i);
+            writeVarint(data, runValue);
+            i = runEnd;
+        }
+    }
+
+    template<typename Setter>
+    void readRuns(const uint8_t*& data, size_t count, Setter set) {
+        size_t i = 0;
+        while (i < count) {
+            auto runLength = readVarint(data);
+            auto value = readVarint(data);
+            for (auto runEnd = i + runLength; i < runEnd; i++) {
+                set(i, value);
+            }
+        }
+    }
+
+    template<typename Function>
+    double measure(Function function) {
+        auto start = std::chrono::steady_clock::now();
+        function();
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    struct Accumulator {
+        uint64_t value {0};
+
+        void add(const Mp4Tracks::Sample& sample) {
+            value += sample.offset + sample.decodeTime + sample.size + sample.duration + sample.flags +
+                    static_cast<uint64_t>(sample.compositionTimeOffset) + sample.sampleDescriptionIndex + sample.fragmentIndex;
+        }
+    };
+
+}
+
+constexpr size_t Mp4Tracks::CompactSamples::BLOCK_SIZE;
+
+Mp4Tracks::CompactSamples::CompactSamples(const std::vector<Sample>& samples)
+    : _size{samples.size()} {
+    for (size_t first = 0; first < samples.size(); first += BLOCK_SIZE) {
+        const auto* block = samples.data() + first;
+        auto count = std::min(BLOCK_SIZE, samples.size() - first);
+
+        _blocks.push_back({ block[0].offset, block[0].decodeTime, _data.size() });
+
+        writeRuns(_data, count, [block](size_t i) { return block[i].duration; });
+        writeRuns(_data, count, [block](size_t i) { return block[i].flags; });
+        writeRuns(_data, count, [block](size_t i) { return block[i].sampleDescriptionIndex; });
+        writeRuns(_data, count, [block](size_t i) { return block[i].fragmentIndex; });
+
+        // samples usually follow each other without gaps both in the file and on the timeline
+        writeRuns(_data, count, [block](size_t i) {
+            return i == 0 ? 0 : zigzag(static_cast<int64_t>(block[i].offset - block[i - 1].offset - block[i - 1].size));
+        });
+        writeRuns(_data, count, [block](size_t i) {
+            return i == 0 ? 0 : zigzag(static_cast<int64_t>(block[i].decodeTime - block[i - 1].decodeTime - block[i - 1].duration));
+        });
+
+        int64_t previousSize = 0;
+        int64_t previousOffset = 0;
+        for (size_t i = 0; i < count; i++) {
+            writeVarint(_data, zigzag(static_cast<int64_t>(block[i].size) - previousSize));
+            previousSize = block[i].size;
+        }
+        for (size_t i = 0; i < count; i++) {
+            writeVarint(_data, zigzag(static_cast<int64_t>(block[i].compositionTimeOffset) - previousOffset));
+            previousOffset = block[i].compositionTimeOffset;
+        }
+    }
+
+    _data.shrink_to_fit();
+}
+
+size_t Mp4Tracks::CompactSamples::size() const noexcept {
+    return _size;
+}
+
+size_t Mp4Tracks::CompactSamples::memoryUsage() const noexcept {
+    return sizeof(*this) + _blocks.capacity() * sizeof(Block) + _data.capacity();
+}
+
+size_t Mp4Tracks::CompactSamples::decodeBlock(size_t block, Sample* out, size_t count) const {
+    const auto& header = _blocks[block];
+    auto blockSize = std::min(BLOCK_SIZE, _size - block * BLOCK_SIZE);
+    const uint8_t* data = _data.data() + header.dataOffset;
+
+    std::array<int64_t, BLOCK_SIZE> offsetGaps;
+    std::array<int64_t, BLOCK_SIZE> timeGaps;
+
+    readRuns(data, blockSize, [out](size_t i, uint64_t value) { out[i].duration = static_cast<unsigned int>(value); });
+    readRuns(data, blockSize, [out](size_t i, uint64_t value) { out[i].flags = static_cast<unsigned int>(value); });
+    readRuns(data, blockSize, [out](size_t i, uint64_t value) { out[i].sampleDescriptionIndex = static_cast<unsigned int>(value); });
+    readRuns(data, blockSize, [out](size_t i, uint64_t value) { out[i].fragmentIndex = static_cast<unsigned int>(value); });
+    readRuns(data, blockSize, [&offsetGaps](size_t i, uint64_t value) { offsetGaps[i] = unzigzag(value); });
+    readRuns(data, blockSize, [&timeGaps](size_t i, uint64_t value) { timeGaps[i] = unzigzag(value); });
+
+    int64_t size = 0;
+    for (size_t i = 0; i < blockSize; i++) {
+        size += unzigzag(readVarint(data));
+        out[i].size = static_cast<unsigned int>(size);
+    }
+
+    int64_t compositionTimeOffset = 0;
+    for (size_t i = 0; i < blockSize; i++) {
+        compositionTimeOffset += unzigzag(readVarint(data));
+        out[i].compositionTimeOffset = static_cast<int>(compositionTimeOffset);
+    }
+
+    out[0].offset = header.firstOffset;
+    out[0].decodeTime = header.firstDecodeTime;
+    for (size_t i = 1; i < std::min(blockSize, count); i++) {
+        out[i].offset = out[i - 1].offset + out[i - 1].size + offsetGaps[i];
+        out[i].decodeTime = out[i - 1].decodeTime + out[i - 1].duration + timeGaps[i];
+    }
+
+    return blockSize;
+}
+
+void Mp4Tracks::CompactSamples::decodeBlock(size_t block, std::vector<Sample>& out) const {
+    out.resize(BLOCK_SIZE);
+    out.resize(decodeBlock(block, out.data(), BLOCK_SIZE));
+}
+
+Mp4Tracks::Sample Mp4Tracks::CompactSamples::at(size_t index) const {
+    if (index >= _size) {
+        throw std::out_of_range("Sample index " + std::to_string(index) + " is out of range");
+    }
+
+    std::array<Sample, BLOCK_SIZE> decoded;
+    auto position = index % BLOCK_SIZE;
+    decodeBlock(index / BLOCK_SIZE, decoded.data(), position + 1);
+    return decoded[position];
+}
+
+size_t Mp4Tracks::CompactSamples::upperBound(unsigned long int decodeTime) const {
+    auto block = std::upper_bound(
+        _blocks.cbegin(),
+        _blocks.cend(),
+        decodeTime,
+        [](unsigned long int value, const Block& block) {
+            return value < block.firstDecodeTime;
+        }
+    );
+
+    if (block == _blocks.cbegin()) {
+        return 0;
+    }
+
+    auto blockIndex = static_cast<size_t>(block - _blocks.cbegin()) - 1;
+    std::array<Sample, BLOCK_SIZE> decoded;
+    auto count = decodeBlock(blockIndex, decoded.data(), BLOCK_SIZE);
+
+    auto position = std::upper_bound(
+        decoded.cbegin(),
+        decoded.cbegin() + count,
+        decodeTime,
+        [](unsigned long int value, const Sample& sample) {
+            return value < sample.decodeTime;
+        }
+    );
+    return blockIndex * BLOCK_SIZE + (position - decoded.cbegin());
+}
+
+std::string Mp4Tracks::CompactSamples::Comparison::toString() const noexcept {
+    auto ratio = compactBytes ? static_cast<double>(vectorBytes) / compactBytes : 0.0;
+    return "\r\tsamples: " + std::to_string(samples) +
+        "\r\n\r\tvector: " + std::to_string(vectorBytes) + " bytes, " +
+            std::to_string(static_cast<unsigned long int>(vectorSamplesPerSecond / 1e6)) + "M samples/s" +
+        "\r\n\r\tcompact: " + std::to_string(compactBytes) + " bytes, " +
+            std::to_string(static_cast<unsigned long int>(compactSamplesPerSecond / 1e6)) + "M samples/s" +
+        "\r\n\r\tratio: " + std::to_string(ratio) + "\r\n";
+}
+
+Mp4Tracks::CompactSamples::Comparison Mp4Tracks::CompactSamples::compare(const std::vector<Sample>& samples) {
+    CompactSamples compact(samples);
+
+    Comparison comparison;
+    comparison.samples = samples.size();
+    comparison.vectorBytes = sizeof(samples) + samples.capacity() * sizeof(Sample);
+    comparison.compactBytes = compact.memoryUsage();
+
+    Accumulator vectorSum;
+    Accumulator compactSum;
+
+    auto vectorSeconds = measure([&]() {
+        for (const auto& sample : samples) {
+            vectorSum.add(sample);
+        }
+    });
+    auto compactSeconds = measure([&]() {
+        compact.forEach([&compactSum](const Sample& sample) {
+            compactSum.add(sample);
+        });
+    });
+
+    if (vectorSum.value != compactSum.value) {
+        throw std::runtime_error("Compact samples differ from the decoded ones");
+    }
+
+    if (vectorSeconds > 0) {
+        comparison.vectorSamplesPerSecond = samples.size() / vectorSeconds;
+    }
+    if (compactSeconds > 0) {
+        comparison.compactSamplesPerSecond = samples.size() / compactSeconds;
+    }
+
+    return comparison;
+}
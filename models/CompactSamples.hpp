@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Mp4Tracks.hpp"
+
+namespace Mp4Tracks {
+
+    /**
+     * Compressed storage of a track timeline.
+     *
+     * Samples are grouped in blocks of BLOCK_SIZE. Every block keeps its first offset and
+     * decode time uncompressed, followed by one varint stream per field:
+     * durations, flags, description and fragment indexes and the gaps between samples
+     * (offset/time jumps, usually zero) are run-length encoded,
+     * sizes and composition time offsets are stored as zigzag deltas.
+     */
+    class CompactSamples {
+    public:
+        static constexpr size_t BLOCK_SIZE = 256;
+
+        explicit CompactSamples(const std::vector<Sample>& samples);
+
+        size_t size() const noexcept;
+        size_t memoryUsage() const noexcept;
+
+        /**
+         * Random access, decodes the block up to index
+         */
+        Sample at(size_t index) const;
+
+        /**
+         * Decodes all samples of a block into out
+         */
+        void decodeBlock(size_t block, std::vector<Sample>& out) const;
+
+        /**
+         * Index of the first sample with decode time after time
+         */
+        size_t upperBound(unsigned long int decodeTime) const;
+
+        template<typename Function>
+        void forEach(Function function) const {
+            std::vector<Sample> decoded;
+            decoded.reserve(BLOCK_SIZE);
+            for (size_t block = 0; block < _blocks.size(); block++) {
+                decodeBlock(block, decoded);
+                for (const auto& sample : decoded) {
+                    function(sample);
+                }
+            }
+        }
+
+        struct Comparison {
+            size_t samples {0};
+            size_t vectorBytes {0};
+            size_t compactBytes {0};
+            double vectorSamplesPerSecond {0};
+            double compactSamplesPerSecond {0};
+
+            std::string toString() const noexcept;
+        };
+
+        /**
+         * Encodes samples and measures memory and full iteration speed against the plain vector
+         */
+        static Comparison compare(const std::vector<Sample>& samples);
+
+    private:
+        struct Block {
+            unsigned long int firstOffset {0};
+            unsigned long int firstDecodeTime {0};
+            size_t dataOffset {0};
+        };
+
+        size_t decodeBlock(size_t block, Sample* out, size_t count) const;
+
+        size_t _size {0};
+        std::vector<Block> _blocks;
+        std::vector<uint8_t> _data;
+    };
+}
@@ -5,7 +5,9 @@
 
 Mp4Boxes::Box::Box(Mp4Boxes::BoxHeader bHeader)
     : size{bHeader.size},
-    type{bHeader.type} {}
+    type{bHeader.type},
+    offset{bHeader.offset},
+    headerSize{bHeader.headerSize} {}
 
 Mp4Boxes::Box::~Box() {
     for (size_t i = 0; i < children.size(); i++) {
@@ -13,6 +15,15 @@ Mp4Boxes::Box::~Box() {
     }
 }
 
+const Mp4Boxes::Box* Mp4Boxes::Box::findChild(const std::string& childType) const noexcept {
+    for (auto child : children) {
+        if (child->type == childType) {
+            return child;
+        }
+    }
+    return nullptr;
+}
+
 std::string Mp4Boxes::Box::toString() const noexcept {
     return type + " ->\r\n\r\tsize: " + std::to_string(size) + "\r\n";
 }
@@ -46,6 +57,46 @@ std::string Mp4Boxes::FtypBox::toString() const noexcept {
     return str;
 }
 
+Mp4Boxes::MvhdBox::MvhdBox(Mp4Boxes::BoxHeader bHeader)
+    : FullBox{bHeader} {}
+
+std::string Mp4Boxes::MvhdBox::toString() const noexcept {
+    return FullBox::toString() +
+        "\r\ttimescale: " + std::to_string(timescale) +
+        "\r\n\r\tduration: " + std::to_string(duration) +
+        "\r\n\r\tnext track id: " + std::to_string(nextTrackId) + "\r\n";
+}
+
+Mp4Boxes::TkhdBox::TkhdBox(Mp4Boxes::BoxHeader bHeader)
+    : FullBox{bHeader} {}
+
+std::string Mp4Boxes::TkhdBox::toString() const noexcept {
+    return FullBox::toString() +
+        "\r\ttrack id: " + std::to_string(trackId) +
+        "\r\n\r\tduration: " + std::to_string(duration) + "\r\n";
+}
+
+Mp4Boxes::MdhdBox::MdhdBox(Mp4Boxes::BoxHeader bHeader)
+    : FullBox{bHeader} {}
+
+std::string Mp4Boxes::MdhdBox::toString() const noexcept {
+    return FullBox::toString() +
+        "\r\ttimescale: " + std::to_string(timescale) +
+        "\r\n\r\tduration: " + std::to_string(duration) + "\r\n";
+}
+
+Mp4Boxes::TrexBox::TrexBox(Mp4Boxes::BoxHeader bHeader)
+    : FullBox{bHeader} {}
+
+std::string Mp4Boxes::TrexBox::toString() const noexcept {
+    return FullBox::toString() +
+        "\r\ttrack id: " + std::to_string(trackId) +
+        "\r\n\r\tdefault sample description index: " + std::to_string(defaultSampleDescriptionIndex) +
+        "\r\n\r\tdefault sample duration: " + std::to_string(defaultSampleDuration) +
+        "\r\n\r\tdefault sample size: " + std::to_string(defaultSampleSize) +
+        "\r\n\r\tdefault sample flags: " + std::to_string(defaultSampleFlags) + "\r\n";
+}
+
 Mp4Boxes::MfhdBox::MfhdBox(Mp4Boxes::BoxHeader bHeader)
     : FullBox{bHeader} {}
 
@@ -9,17 +9,23 @@ namespace Mp4Boxes {
     struct BoxHeader {
         unsigned long int size {0};
         std::string type;
+        unsigned long int offset {0};
+        unsigned int headerSize {8};
     };
     
     struct Box {
         explicit Box(BoxHeader bHeader);
-        ~Box();
+        virtual ~Box();
 
         unsigned long int size {0};
         std::string type;
+        unsigned long int offset {0};
+        unsigned int headerSize {8};
 
         std::vector<Box*> children;
 
+        const Box* findChild(const std::string& childType) const noexcept;
+
         virtual std::string toString() const noexcept;
     };
 
@@ -42,6 +48,46 @@ namespace Mp4Boxes {
         std::string toString() const noexcept override;
     };
 
+    struct MvhdBox : FullBox {
+        explicit MvhdBox(BoxHeader bHeader);
+
+        unsigned int timescale {0};
+        unsigned long int duration {0};
+        unsigned int nextTrackId {0};
+
+        std::string toString() const noexcept override;
+    };
+
+    struct TkhdBox : FullBox {
+        explicit TkhdBox(BoxHeader bHeader);
+
+        unsigned int trackId {0};
+        unsigned long int duration {0};
+
+        std::string toString() const noexcept override;
+    };
+
+    struct MdhdBox : FullBox {
+        explicit MdhdBox(BoxHeader bHeader);
+
+        unsigned int timescale {0};
+        unsigned long int duration {0};
+
+        std::string toString() const noexcept override;
+    };
+
+    struct TrexBox : FullBox {
+        explicit TrexBox(BoxHeader bHeader);
+
+        unsigned int trackId {0};
+        unsigned int defaultSampleDescriptionIndex {0};
+        unsigned int defaultSampleDuration {0};
+        unsigned int defaultSampleSize {0};
+        unsigned int defaultSampleFlags {0};
+
+        std::string toString() const noexcept override;
+    };
+
     struct MfhdBox : FullBox {
         explicit MfhdBox(BoxHeader bHeader);
 
@@ -69,7 +115,7 @@ namespace Mp4Boxes {
     struct TfdtBox : FullBox {
         explicit TfdtBox(BoxHeader bHeader);
 
-        unsigned long int baseMediaDecodeTime;
+        unsigned long int baseMediaDecodeTime {0};
 
         std::string toString() const noexcept override;
     };
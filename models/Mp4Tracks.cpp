@@ -0,0 +1,268 @@
+
+#include "Mp4Tracks.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+    constexpr unsigned int SAMPLE_IS_NON_SYNC_SAMPLE = 0x00010000;
+
+    /**
+     * Upper bound for truns without per-sample fields, their sample count is not backed by
+     * any table in the box (about 20 s of 48 kHz audio with one sample per frame)
+     */
+    constexpr size_t MAX_IMPLICIT_TRUN_SAMPLES = 1 << 20;
+
+    void collectTrak(const Mp4Boxes::Box& trak, Mp4Tracks::Movie& movie) {
+        Mp4Tracks::Track track;
+
+        auto tkhd = static_cast<const Mp4Boxes::TkhdBox*>(trak.findChild("tkhd"));
+        if (!tkhd) {
+            throw std::runtime_error("Track without tkhd box");
+        }
+        track.trackId = tkhd->trackId;
+
+        auto mdia = trak.findChild("mdia");
+        if (mdia) {
+            auto mdhd = static_cast<const Mp4Boxes::MdhdBox*>(mdia->findChild("mdhd"));
+            if (mdhd) {
+                track.timescale = mdhd->timescale;
+            }
+        }
+
+        movie.tracks.push_back(track);
+    }
+
+    void collectMoov(
+                const Mp4Boxes::Box& moov,
+                Mp4Tracks::Movie& movie,
+                std::map<unsigned int, Mp4Tracks::TrackDefaults>& defaults) {
+        for (auto child : moov.children) {
+            if (child->type == "mvhd") {
+                movie.timescale = static_cast<const Mp4Boxes::MvhdBox*>(child)->timescale;
+            } else if (child->type == "trak") {
+                collectTrak(*child, movie);
+            } else if (child->type == "mvex") {
+                for (auto mvexChild : child->children) {
+                    if (mvexChild->type != "trex") {
+                        continue;
+                    }
+                    auto trex = static_cast<const Mp4Boxes::TrexBox*>(mvexChild);
+                    auto& trackDefaults = defaults[trex->trackId];
+                    trackDefaults.sampleDescriptionIndex = trex->defaultSampleDescriptionIndex;
+                    trackDefaults.sampleDuration = trex->defaultSampleDuration;
+                    trackDefaults.sampleSize = trex->defaultSampleSize;
+                    trackDefaults.sampleFlags = trex->defaultSampleFlags;
+                }
+            }
+        }
+    }
+
+    Mp4Tracks::Track& findTrack(Mp4Tracks::Movie& movie, unsigned int trackId) {
+        for (auto& track : movie.tracks) {
+            if (track.trackId == trackId) {
+                return track;
+            }
+        }
+        throw std::runtime_error("Fragment refers to unknown track " + std::to_string(trackId));
+    }
+
+    void collectMoof(
+                const Mp4Boxes::Box& moof,
+                Mp4Tracks::Movie& movie,
+                std::map<unsigned int, Mp4Tracks::TrackDefaults>& defaults) {
+        Mp4Tracks::Fragment fragment;
+        fragment.offset = moof.offset;
+        fragment.size = moof.size;
+
+        auto mfhd = static_cast<const Mp4Boxes::MfhdBox*>(moof.findChild("mfhd"));
+        if (mfhd) {
+            fragment.sequenceNumber = mfhd->sequenceNumber;
+        }
+
+        auto fragmentIndex = static_cast<unsigned int>(movie.fragments.size());
+        movie.fragments.push_back(fragment);
+
+        bool firstTraf = true;
+        unsigned long int previousTrafEnd = moof.offset;
+
+        for (auto traf : moof.children) {
+            if (traf->type != "traf") {
+                continue;
+            }
+
+            auto tfhd = static_cast<const Mp4Boxes::TfhdBox*>(traf->findChild("tfhd"));
+            if (!tfhd) {
+                throw std::runtime_error("Track fragment without tfhd box");
+            }
+
+            auto& track = findTrack(movie, tfhd->trackId);
+            auto trackDefaults = defaults[tfhd->trackId];
+
+            if (tfhd->flags & 0x00000002) {
+                trackDefaults.sampleDescriptionIndex = tfhd->sampleDescriptionIndex;
+            }
+            if (tfhd->flags & 0x00000008) {
+                trackDefaults.sampleDuration = tfhd->defaultSampleDuration;
+            }
+            if (tfhd->flags & 0x00000010) {
+                trackDefaults.sampleSize = tfhd->defaultSampleSize;
+            }
+            if (tfhd->flags & 0x00000020) {
+                trackDefaults.sampleFlags = tfhd->defaultSampleFlags;
+            }
+
+            unsigned long int baseOffset = 0;
+            if (tfhd->flags & 0x00000001) {
+                baseOffset = tfhd->baseDataOffset;
+            } else if (tfhd->defaultBaseIsMoof || firstTraf) {
+                baseOffset = moof.offset;
+            } else {
+                baseOffset = previousTrafEnd;
+            }
+
+            unsigned long int decodeTime = track.nextDecodeTime;
+
+            auto tfdt = static_cast<const Mp4Boxes::TfdtBox*>(traf->findChild("tfdt"));
+            if (tfdt) {
+                decodeTime = tfdt->baseMediaDecodeTime;
+            }
+
+            unsigned long int dataCursor = baseOffset;
+
+            for (auto trafChild : traf->children) {
+                if (trafChild->type != "trun") {
+                    continue;
+                }
+                auto trun = static_cast<const Mp4Boxes::TrunBox*>(trafChild);
+
+                if (trun->flags & 0x00000001) {
+                    dataCursor = baseOffset + trun->dataOffset;
+                }
+
+                // duration, size, flags or composition time offset per sample
+                bool hasSampleFields = trun->flags & 0x00000f00;
+                auto samplesCount = hasSampleFields ? trun->samples.size() :
+                        std::min<size_t>(trun->sampleCount, MAX_IMPLICIT_TRUN_SAMPLES);
+
+                const Mp4Boxes::TrunBox::TrunSample noSampleFields;
+
+                for (size_t i = 0; i < samplesCount; i++) {
+                    const auto& trunSample = hasSampleFields ? trun->samples[i] : noSampleFields;
+                    Mp4Tracks::Sample sample;
+
+                    sample.duration = (trun->flags & 0x00000100) ?
+                            trunSample.sampleDuration : trackDefaults.sampleDuration;
+                    sample.size = (trun->flags & 0x00000200) ?
+                            trunSample.sampleSize : trackDefaults.sampleSize;
+
+                    if (i == 0 && (trun->flags & 0x00000004)) {
+                        sample.flags = trun->firstSampleFlags;
+                    } else if (trun->flags & 0x00000400) {
+                        sample.flags = trunSample.sampleFlags;
+                    } else {
+                        sample.flags = trackDefaults.sampleFlags;
+                    }
+
+                    if (trun->flags & 0x00000800) {
+                        sample.compositionTimeOffset = trun->version == 0 ?
+                                static_cast<int>(trunSample.sampleCompositionTimeOffset) :
+                                trunSample.sampleCompositionTimeOffsetSigned;
+                    }
+
+                    sample.offset = dataCursor;
+                    sample.decodeTime = decodeTime;
+                    sample.sampleDescriptionIndex = trackDefaults.sampleDescriptionIndex;
+                    sample.fragmentIndex = fragmentIndex;
+
+                    dataCursor += sample.size;
+                    decodeTime += sample.duration;
+
+                    track.samples.push_back(sample);
+                }
+            }
+
+            track.nextDecodeTime = decodeTime;
+            previousTrafEnd = dataCursor;
+            firstTraf = false;
+        }
+    }
+
+}
+
+bool Mp4Tracks::Sample::isSync() const noexcept {
+    return !(flags & SAMPLE_IS_NON_SYNC_SAMPLE);
+}
+
+unsigned long int Mp4Tracks::Track::duration() const noexcept {
+    if (samples.empty()) {
+        return 0;
+    }
+    return samples.back().decodeTime + samples.back().duration - samples.front().decodeTime;
+}
+
+const Mp4Tracks::MediaData* Mp4Tracks::Movie::findMediaData(
+        unsigned long int offset, unsigned long int size) const noexcept {
+    auto it = std::upper_bound(
+        mediaData.cbegin(),
+        mediaData.cend(),
+        offset,
+        [](unsigned long int value, const MediaData& mdat) {
+            return value < mdat.offset;
+        }
+    );
+
+    if (it == mediaData.cbegin()) {
+        return nullptr;
+    }
+
+    --it;
+    if (offset < it->offset + it->headerSize || offset + size > it->offset + it->size) {
+        return nullptr;
+    }
+
+    return &*it;
+}
+
+std::string Mp4Tracks::Movie::toString() const noexcept {
+    std::string str = "movie ->\r\n\r\ttimescale: " + std::to_string(timescale) +
+        "\r\n\r\tfragments: " + std::to_string(fragments.size()) + "\r\n";
+    for (const auto& track : tracks) {
+        str += "\r\ttrack " + std::to_string(track.trackId) +
+            ": timescale " + std::to_string(track.timescale) +
+            ", samples " + std::to_string(track.samples.size()) +
+            ", duration " + std::to_string(track.duration()) + "\r\n";
+    }
+    return str;
+}
+
+void Mp4Tracks::Collector::add(const Mp4Boxes::Box& topLevelBox) {
+    if (topLevelBox.type == "moov") {
+        collectMoov(topLevelBox, _movie, _defaults);
+    } else if (topLevelBox.type == "moof") {
+        collectMoof(topLevelBox, _movie, _defaults);
+    } else if (topLevelBox.type == "mdat") {
+        _movie.mediaData.push_back({ topLevelBox.offset, topLevelBox.size, topLevelBox.headerSize });
+    }
+}
+
+const Mp4Tracks::Movie& Mp4Tracks::Collector::movie() const noexcept {
+    return _movie;
+}
+
+void Mp4Tracks::Collector::clearCollected() noexcept {
+    for (auto& track : _movie.tracks) {
+        track.samples.clear();
+    }
+    _movie.fragments.clear();
+    _movie.mediaData.clear();
+}
+
+Mp4Tracks::Movie Mp4Tracks::collect(const Mp4Boxes::Box& root) {
+    Collector collector;
+    for (auto box : root.children) {
+        collector.add(*box);
+    }
+    return collector.movie();
+}
@@ -0,0 +1,98 @@
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Mp4Boxes.hpp"
+
+namespace Mp4Tracks {
+
+    /**
+     * Fully resolved sample: trun values with tfhd/trex defaults applied
+     * and absolute position of the sample payload in the source file
+     */
+    struct Sample {
+        unsigned long int offset {0};
+        unsigned long int decodeTime {0};
+        unsigned int size {0};
+        unsigned int duration {0};
+        unsigned int flags {0};
+        int compositionTimeOffset {0};
+        unsigned int sampleDescriptionIndex {1};
+        unsigned int fragmentIndex {0};
+
+        bool isSync() const noexcept;
+    };
+
+    struct Track {
+        unsigned int trackId {0};
+        unsigned int timescale {0};
+        std::vector<Sample> samples;
+
+        /**
+         * Decode time of the sample that follows the last collected one,
+         * used when a traf has no tfdt
+         */
+        unsigned long int nextDecodeTime {0};
+
+        unsigned long int duration() const noexcept;
+    };
+
+    struct Fragment {
+        unsigned long int offset {0};
+        unsigned long int size {0};
+        unsigned int sequenceNumber {0};
+    };
+
+    struct MediaData {
+        unsigned long int offset {0};
+        unsigned long int size {0};
+        unsigned int headerSize {8};
+    };
+
+    struct Movie {
+        unsigned int timescale {0};
+        std::vector<Track> tracks;
+        std::vector<Fragment> fragments;
+        std::vector<MediaData> mediaData;
+
+        const MediaData* findMediaData(unsigned long int offset, unsigned long int size) const noexcept;
+
+        std::string toString() const noexcept;
+    };
+
+    struct TrackDefaults {
+        unsigned int sampleDescriptionIndex {1};
+        unsigned int sampleDuration {0};
+        unsigned int sampleSize {0};
+        unsigned int sampleFlags {0};
+    };
+
+    /**
+     * Builds timelines incrementally from top-level boxes in file order.
+     * Keeps the running state (tracks, trex defaults, decode times) between calls,
+     * so boxes appended to a growing file can be added later.
+     */
+    class Collector {
+    public:
+        void add(const Mp4Boxes::Box& topLevelBox);
+
+        const Movie& movie() const noexcept;
+
+        /**
+         * Drops collected samples, fragments and mdat positions, keeps the running state
+         */
+        void clearCollected() noexcept;
+
+    private:
+        Movie _movie;
+        std::map<unsigned int, TrackDefaults> _defaults;
+    };
+
+    /**
+     * Builds per-track sample timelines from the moov/moof boxes of a parsed file
+     */
+    Movie collect(const Mp4Boxes::Box& root);
+}
@@ -0,0 +1,349 @@
+#include "SampleDecoders.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "../utils/Helpers.hpp"
+
+namespace {
+
+    using TrunSample = Mp4Boxes::TrunBox::TrunSample;
+
+    /**
+     * Field schema: the flag that makes a field present, its width and where it is stored.
+     * Fields of a schema are listed in the order they appear in the box.
+     */
+    template<unsigned int FLAG, size_t WIDTH>
+    struct Field {
+        static constexpr unsigned int flag = FLAG;
+        static constexpr size_t width = WIDTH;
+    };
+
+    struct SampleDuration : Field<0x00000100, 4> {
+        static void store(const uint8_t* data, TrunSample& sample) {
+            sample.sampleDuration = Helpers::readU32(data);
+        }
+    };
+
+    struct SampleSize : Field<0x00000200, 4> {
+        static void store(const uint8_t* data, TrunSample& sample) {
+            sample.sampleSize = Helpers::readU32(data);
+        }
+    };
+
+    struct SampleFlags : Field<0x00000400, 4> {
+        static void store(const uint8_t* data, TrunSample& sample) {
+            sample.sampleFlags = Helpers::readU32(data);
+        }
+    };
+
+    struct SampleCompositionTimeOffset : Field<0x00000800, 4> {
+        static void store(const uint8_t* data, TrunSample& sample) {
+            sample.sampleCompositionTimeOffset = Helpers::readU32(data);
+        }
+    };
+
+    struct SampleCompositionTimeOffsetSigned : Field<0x00000800, 4> {
+        static void store(const uint8_t* data, TrunSample& sample) {
+            sample.sampleCompositionTimeOffsetSigned = static_cast<int>(Helpers::readU32(data));
+        }
+    };
+
+    struct BaseDataOffset : Field<0x00000001, 8> {
+        static void store(const uint8_t* data, Mp4Boxes::TfhdBox& box) {
+            box.baseDataOffset = Helpers::readU64(data);
+        }
+    };
+
+    struct SampleDescriptionIndex : Field<0x00000002, 4> {
+        static void store(const uint8_t* data, Mp4Boxes::TfhdBox& box) {
+            box.sampleDescriptionIndex = Helpers::readU32(data);
+        }
+    };
+
+    struct DefaultSampleDuration : Field<0x00000008, 4> {
+        static void store(const uint8_t* data, Mp4Boxes::TfhdBox& box) {
+            box.defaultSampleDuration = Helpers::readU32(data);
+        }
+    };
+
+    struct DefaultSampleSize : Field<0x00000010, 4> {
+        static void store(const uint8_t* data, Mp4Boxes::TfhdBox& box) {
+            box.defaultSampleSize = Helpers::readU32(data);
+        }
+    };
+
+    struct DefaultSampleFlags : Field<0x00000020, 4> {
+        static void store(const uint8_t* data, Mp4Boxes::TfhdBox& box) {
+            box.defaultSampleFlags = Helpers::readU32(data);
+        }
+    };
+
+    template<typename... Fields>
+    struct Schema {};
+
+    using TrunSampleSchema = Schema<SampleDuration, SampleSize, SampleFlags, SampleCompositionTimeOffset>;
+    using SignedTrunSampleSchema = Schema<SampleDuration, SampleSize, SampleFlags, SampleCompositionTimeOffsetSigned>;
+    using TfhdSchema = Schema<BaseDataOffset, SampleDescriptionIndex, DefaultSampleDuration, DefaultSampleSize, DefaultSampleFlags>;
+
+    template<bool PRESENT, typename FieldType>
+    struct Store {
+        template<typename Record>
+        static void apply(const uint8_t* data, Record& record) {
+            FieldType::store(data, record);
+        }
+    };
+
+    template<typename FieldType>
+    struct Store<false, FieldType> {
+        template<typename Record>
+        static void apply(const uint8_t*, Record&) {}
+    };
+
+    /**
+     * Record layout of a schema for fixed flags: total size and a decoder with constant field offsets
+     */
+    template<unsigned int FLAGS, typename SchemaType>
+    struct Layout;
+
+    template<unsigned int FLAGS>
+    struct Layout<FLAGS, Schema<>> {
+        static constexpr size_t size = 0;
+
+        template<typename Record>
+        static void decode(const uint8_t*, Record&) {}
+    };
+
+    template<unsigned int FLAGS, typename FieldType, typename... Rest>
+    struct Layout<FLAGS, Schema<FieldType, Rest...>> {
+        static constexpr bool present = (FLAGS & FieldType::flag) != 0;
+        static constexpr size_t width = present ? FieldType::width : 0;
+
+        using Tail = Layout<FLAGS, Schema<Rest...>>;
+
+        static constexpr size_t size = width + Tail::size;
+
+        template<typename Record>
+        static void decode(const uint8_t* data, Record& record) {
+            Store<present, FieldType>::apply(data, record);
+            Tail::decode(data + width, record);
+        }
+    };
+
+    /**
+     * Decoder index: bits 0-3 are trun flags 0x100-0x800, bit 4 selects signed composition offsets
+     */
+    template<unsigned int INDEX>
+    struct TrunDecoder {
+        static constexpr unsigned int flags = (INDEX & 0x0F) << 8;
+
+        using SchemaType = typename std::conditional<(INDEX & 0x10) != 0, SignedTrunSampleSchema, TrunSampleSchema>::type;
+        using LayoutType = Layout<flags, SchemaType>;
+
+        static void decode(const uint8_t* data, size_t count, std::vector<TrunSample>& samples) {
+            samples.clear();
+            samples.resize(count);
+            auto out = samples.data();
+            for (size_t i = 0; i < count; i++) {
+                LayoutType::decode(data + i * LayoutType::size, out[i]);
+            }
+        }
+    };
+
+    /**
+     * Decoder index: bits 0-1 are tfhd flags 0x01-0x02, bits 2-4 are flags 0x08-0x20
+     */
+    template<unsigned int INDEX>
+    struct TfhdDecoder {
+        static constexpr unsigned int flags = (INDEX & 0x03) | ((INDEX & 0x1C) << 1);
+
+        using LayoutType = Layout<flags, TfhdSchema>;
+
+        static void decode(const uint8_t* data, Mp4Boxes::TfhdBox& box) {
+            LayoutType::decode(data, box);
+        }
+    };
+
+    using TrunDecodeFunction = void (*)(const uint8_t*, size_t, std::vector<TrunSample>&);
+    using TfhdDecodeFunction = void (*)(const uint8_t*, Mp4Boxes::TfhdBox&);
+
+    struct TrunEntry {
+        TrunDecodeFunction decode;
+        size_t size;
+    };
+
+    struct TfhdEntry {
+        TfhdDecodeFunction decode;
+        size_t size;
+    };
+
+    template<size_t... INDEXES>
+    constexpr std::array<TrunEntry, sizeof...(INDEXES)> makeTrunTable(std::index_sequence<INDEXES...>) {
+        return {{ { &TrunDecoder<INDEXES>::decode, TrunDecoder<INDEXES>::LayoutType::size }... }};
+    }
+
+    template<size_t... INDEXES>
+    constexpr std::array<TfhdEntry, sizeof...(INDEXES)> makeTfhdTable(std::index_sequence<INDEXES...>) {
+        return {{ { &TfhdDecoder<INDEXES>::decode, TfhdDecoder<INDEXES>::LayoutType::size }... }};
+    }
+
+    const auto TRUN_DECODERS = makeTrunTable(std::make_index_sequence<32>());
+    const auto TFHD_DECODERS = makeTfhdTable(std::make_index_sequence<32>());
+
+    inline unsigned int trunIndex(unsigned int flags, unsigned int version) {
+        auto index = (flags >> 8) & 0x0F;
+        if (version != 0 && (flags & 0x00000800)) {
+            index |= 0x10;
+        }
+        return index;
+    }
+
+    inline unsigned int tfhdIndex(unsigned int flags) {
+        return (flags & 0x03) | ((flags >> 1) & 0x1C);
+    }
+
+    bool sameSamples(const std::vector<TrunSample>& left, const std::vector<TrunSample>& right) {
+        if (left.size() != right.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < left.size(); i++) {
+            if (left[i].sampleDuration != right[i].sampleDuration ||
+                    left[i].sampleSize != right[i].sampleSize ||
+                    left[i].sampleFlags != right[i].sampleFlags ||
+                    left[i].sampleCompositionTimeOffset != right[i].sampleCompositionTimeOffset ||
+                    left[i].sampleCompositionTimeOffsetSigned != right[i].sampleCompositionTimeOffsetSigned) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Best of a few runs, the first one also pays for touching fresh output pages
+     */
+    template<typename Function>
+    double measure(Function function) {
+        double best = 0;
+        for (int run = 0; run < 3; run++) {
+            auto start = std::chrono::steady_clock::now();
+            function();
+            auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (run == 0 || seconds < best) {
+                best = seconds;
+            }
+        }
+        return best;
+    }
+
+}
+
+size_t SampleDecoders::trunSampleSize(unsigned int flags) noexcept {
+    return TRUN_DECODERS[trunIndex(flags, 0)].size;
+}
+
+void SampleDecoders::decodeTrunSamples(
+        unsigned int flags,
+        unsigned int version,
+        const uint8_t* data,
+        size_t count,
+        std::vector<Mp4Boxes::TrunBox::TrunSample>& samples) {
+    TRUN_DECODERS[trunIndex(flags, version)].decode(data, count, samples);
+}
+
+size_t SampleDecoders::tfhdFieldsSize(unsigned int flags) noexcept {
+    return TFHD_DECODERS[tfhdIndex(flags)].size;
+}
+
+void SampleDecoders::decodeTfhdFields(unsigned int flags, const uint8_t* data, Mp4Boxes::TfhdBox& box) {
+    TFHD_DECODERS[tfhdIndex(flags)].decode(data, box);
+}
+
+void SampleDecoders::decodeTrunSamplesGeneric(
+        unsigned int flags,
+        unsigned int version,
+        const uint8_t* data,
+        size_t count,
+        std::vector<Mp4Boxes::TrunBox::TrunSample>& samples) {
+    auto sampleDurationPresent = flags & 0x00000100;
+    auto sampleSizePresent = flags & 0x00000200;
+    auto sampleFlagsPresent = flags & 0x00000400;
+    auto sampleCompositionTimeOffsetPresent = flags & 0x00000800;
+
+    samples.clear();
+    for (size_t i = 0; i < count; i++) {
+        TrunSample sample;
+        if (sampleDurationPresent) {
+            sample.sampleDuration = Helpers::readU32(data);
+            data += 4;
+        }
+        if (sampleSizePresent) {
+            sample.sampleSize = Helpers::readU32(data);
+            data += 4;
+        }
+        if (sampleFlagsPresent) {
+            sample.sampleFlags = Helpers::readU32(data);
+            data += 4;
+        }
+        if (sampleCompositionTimeOffsetPresent) {
+            if (version == 0) {
+                sample.sampleCompositionTimeOffset = Helpers::readU32(data);
+            } else {
+                sample.sampleCompositionTimeOffsetSigned = static_cast<int>(Helpers::readU32(data));
+            }
+            data += 4;
+        }
+        samples.push_back(sample);
+    }
+}
+
+std::string SampleDecoders::benchmark(size_t samplesCount) {
+    std::mt19937 random(1);
+    std::vector<uint8_t> data(samplesCount * 16);
+    for (auto& byte : data) {
+        byte = static_cast<uint8_t>(random());
+    }
+
+    std::string report = "trun decoders, " + std::to_string(samplesCount) + " samples ->\r\n";
+
+    std::vector<TrunSample> generic;
+    std::vector<TrunSample> generated;
+    generic.reserve(samplesCount);
+    generated.reserve(samplesCount);
+
+    for (unsigned int version = 0; version < 2; version++) {
+        for (unsigned int fields = 0; fields < 16; fields++) {
+            auto flags = fields << 8;
+            if (version == 1 && !(flags & 0x00000800)) {
+                continue;
+            }
+
+            auto genericSeconds = measure([&]() {
+                decodeTrunSamplesGeneric(flags, version, data.data(), samplesCount, generic);
+            });
+            auto generatedSeconds = measure([&]() {
+                decodeTrunSamples(flags, version, data.data(), samplesCount, generated);
+            });
+
+            if (!sameSamples(generic, generated)) {
+                throw std::runtime_error("Generated trun decoder differs for flags " + std::to_string(flags));
+            }
+
+            char line[160];
+            std::snprintf(line, sizeof(line),
+                "\r\tversion %u flags 0x%03x stride %2zu: generic %7.1f M/s, generated %7.1f M/s, x%.2f\r\n",
+                version, flags, trunSampleSize(flags),
+                samplesCount / genericSeconds / 1e6,
+                samplesCount / generatedSeconds / 1e6,
+                genericSeconds / generatedSeconds);
+            report += line;
+        }
+    }
+
+    return report;
+}
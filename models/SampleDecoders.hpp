@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Mp4Boxes.hpp"
+
+/**
+ * Decoders of the optional fields of trun and tfhd.
+ *
+ * One decoder is generated at compile time for every flag combination from a
+ * declarative field schema and picked once per box from a jump table,
+ * so the per-sample loop has a fixed stride and no flag tests.
+ */
+namespace SampleDecoders {
+
+    /**
+     * Bytes taken by one trun sample record with the given flags
+     */
+    size_t trunSampleSize(unsigned int flags) noexcept;
+
+    /**
+     * Decodes count sample records of stride trunSampleSize(flags) into samples
+     */
+    void decodeTrunSamples(
+                unsigned int flags,
+                unsigned int version,
+                const uint8_t* data,
+                size_t count,
+                std::vector<Mp4Boxes::TrunBox::TrunSample>& samples);
+
+    /**
+     * Bytes taken by the optional tfhd fields that follow track id
+     */
+    size_t tfhdFieldsSize(unsigned int flags) noexcept;
+
+    void decodeTfhdFields(unsigned int flags, const uint8_t* data, Mp4Boxes::TfhdBox& box);
+
+    /**
+     * Reference decoder that tests every flag for every sample
+     */
+    void decodeTrunSamplesGeneric(
+                unsigned int flags,
+                unsigned int version,
+                const uint8_t* data,
+                size_t count,
+                std::vector<Mp4Boxes::TrunBox::TrunSample>& samples);
+
+    /**
+     * Compares generated and reference decoders on every trun flag combination
+     */
+    std::string benchmark(size_t samplesCount);
+}
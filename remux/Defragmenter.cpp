@@ -0,0 +1,594 @@
+#include "Defragmenter.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#include "../Mp4Analyzer.hpp"
+#include "../models/Mp4Boxes.hpp"
+#include "../models/Mp4Tracks.hpp"
+#include "../utils/BoxWriter.hpp"
+#include "../utils/FileCopy.hpp"
+#include "../utils/Helpers.hpp"
+
+namespace {
+
+    struct Chunk {
+        unsigned long int offset {0};
+        unsigned int samplesCount {0};
+        unsigned int sampleDescriptionIndex {1};
+    };
+
+    /**
+     * Position of every source mdat payload inside the output mdat payload
+     */
+    struct PayloadLayout {
+        std::vector<unsigned long int> relativeOffsets;
+        unsigned long int totalSize {0};
+    };
+
+    struct RawBox {
+        std::string type;
+        const uint8_t* data {nullptr};
+        size_t size {0};
+        size_t headerSize {8};
+    };
+
+    std::vector<RawBox> rawChildren(const uint8_t* data, size_t size) {
+        std::vector<RawBox> children;
+        size_t offset = 0;
+        while (offset + 8 <= size) {
+            RawBox box;
+            box.data = data + offset;
+            box.size = Helpers::readU32(box.data);
+            box.type.assign(reinterpret_cast<const char*>(box.data + 4), 4);
+            if (box.size == 1 && offset + 16 <= size) {
+                box.size = Helpers::readU64(box.data + 8);
+                box.headerSize = 16;
+            } else if (box.size == 0) {
+                box.size = size - offset;
+            }
+            if (box.size < box.headerSize || offset + box.size > size) {
+                throw std::runtime_error("Corrupted " + box.type + " box inside moov");
+            }
+            children.push_back(box);
+            offset += box.size;
+        }
+        return children;
+    }
+
+    /**
+     * Copies a movie/track/media header and overwrites its duration field.
+     * durationPosition is the offset of the field after the full box header in version 0 layout,
+     * version 1 layout has both times widened to 64 bit.
+     */
+    void writeHeaderWithDuration(BoxWriter& writer, const RawBox& box, size_t durationPosition, uint64_t duration) {
+        auto start = writer.size();
+        writer.bytes(box.data, box.size);
+
+        auto version = box.data[box.headerSize];
+        auto position = start + box.headerSize + 4;
+        if (version == 1) {
+            position += durationPosition + 8;
+            writer.patchU64(position, duration);
+        } else {
+            position += durationPosition;
+            writer.patchU32(position, static_cast<uint32_t>(std::min<uint64_t>(duration, UINT32_MAX)));
+        }
+    }
+
+    uint64_t rescale(uint64_t value, uint32_t fromTimescale, uint32_t toTimescale) {
+        if (fromTimescale == 0 || fromTimescale == toTimescale) {
+            return value;
+        }
+        return static_cast<uint64_t>(static_cast<long double>(value) * toTimescale / fromTimescale);
+    }
+
+    /**
+     * Media time of the first non-empty edit of the source edit list, it shifts composition times
+     */
+    int64_t firstMediaTime(const RawBox& edts) {
+        for (const auto& child : rawChildren(edts.data + edts.headerSize, edts.size - edts.headerSize)) {
+            if (child.type != "elst" || child.size < child.headerSize + 8) {
+                continue;
+            }
+            const auto* data = child.data + child.headerSize;
+            auto version = data[0];
+            auto entries = Helpers::readU32(data + 4);
+            size_t entrySize = version == 1 ? 20 : 12;
+            data += 8;
+            for (uint32_t i = 0; i < entries && data + entrySize <= child.data + child.size; i++, data += entrySize) {
+                int64_t mediaTime = version == 1 ? static_cast<int64_t>(Helpers::readU64(data + 8)) :
+                        static_cast<int32_t>(Helpers::readU32(data + 4));
+                if (mediaTime != -1) {
+                    return mediaTime;
+                }
+            }
+        }
+        return 0;
+    }
+
+    PayloadLayout buildPayloadLayout(const Mp4Tracks::Movie& movie) {
+        PayloadLayout layout;
+        for (const auto& mdat : movie.mediaData) {
+            layout.relativeOffsets.push_back(layout.totalSize);
+            layout.totalSize += mdat.size - mdat.headerSize;
+        }
+        return layout;
+    }
+
+    /**
+     * Groups samples that are stored back to back in the output into chunks,
+     * chunk offsets are relative to the beginning of the output mdat payload
+     */
+    std::vector<Chunk> buildChunks(
+                const Mp4Tracks::Movie& movie,
+                const PayloadLayout& layout,
+                const Mp4Tracks::Track& track) {
+        std::vector<Chunk> chunks;
+        unsigned long int chunkEnd = 0;
+
+        for (const auto& sample : track.samples) {
+            auto mdat = movie.findMediaData(sample.offset, sample.size);
+            if (!mdat) {
+                throw std::runtime_error("Sample of track " + std::to_string(track.trackId) +
+                        " at offset " + std::to_string(sample.offset) + " is outside of any mdat");
+            }
+
+            auto mdatIndex = mdat - movie.mediaData.data();
+            auto offset = layout.relativeOffsets[mdatIndex] + (sample.offset - mdat->offset - mdat->headerSize);
+
+            if (chunks.empty() || offset != chunkEnd ||
+                    chunks.back().sampleDescriptionIndex != sample.sampleDescriptionIndex) {
+                chunks.push_back({ offset, 0, sample.sampleDescriptionIndex });
+            }
+
+            chunks.back().samplesCount++;
+            chunkEnd = offset + sample.size;
+        }
+
+        return chunks;
+    }
+
+    void writeStts(BoxWriter& writer, const Mp4Tracks::Track& track) {
+        std::vector<std::pair<uint32_t, uint32_t>> entries;
+        for (const auto& sample : track.samples) {
+            if (entries.empty() || entries.back().second != sample.duration) {
+                entries.emplace_back(0, sample.duration);
+            }
+            entries.back().first++;
+        }
+
+        auto box = writer.beginFullBox("stts", 0, 0);
+        writer.u32(static_cast<uint32_t>(entries.size()));
+        for (const auto& entry : entries) {
+            writer.u32(entry.first);
+            writer.u32(entry.second);
+        }
+        writer.endBox(box);
+    }
+
+    void writeCtts(BoxWriter& writer, const Mp4Tracks::Track& track) {
+        bool hasOffsets = false;
+        bool hasNegativeOffsets = false;
+        for (const auto& sample : track.samples) {
+            hasOffsets |= sample.compositionTimeOffset != 0;
+            hasNegativeOffsets |= sample.compositionTimeOffset < 0;
+        }
+
+        if (!hasOffsets) {
+            return;
+        }
+
+        std::vector<std::pair<uint32_t, int32_t>> entries;
+        for (const auto& sample : track.samples) {
+            if (entries.empty() || entries.back().second != sample.compositionTimeOffset) {
+                entries.emplace_back(0, sample.compositionTimeOffset);
+            }
+            entries.back().first++;
+        }
+
+        auto box = writer.beginFullBox("ctts", hasNegativeOffsets ? 1 : 0, 0);
+        writer.u32(static_cast<uint32_t>(entries.size()));
+        for (const auto& entry : entries) {
+            writer.u32(entry.first);
+            writer.u32(static_cast<uint32_t>(entry.second));
+        }
+        writer.endBox(box);
+    }
+
+    void writeStss(BoxWriter& writer, const Mp4Tracks::Track& track) {
+        std::vector<uint32_t> syncSamples;
+        for (size_t i = 0; i < track.samples.size(); i++) {
+            if (track.samples[i].isSync()) {
+                syncSamples.push_back(static_cast<uint32_t>(i + 1));
+            }
+        }
+
+        // absence of stss means that every sample is a sync sample
+        if (syncSamples.size() == track.samples.size()) {
+            return;
+        }
+
+        auto box = writer.beginFullBox("stss", 0, 0);
+        writer.u32(static_cast<uint32_t>(syncSamples.size()));
+        for (auto sampleNumber : syncSamples) {
+            writer.u32(sampleNumber);
+        }
+        writer.endBox(box);
+    }
+
+    void writeStsz(BoxWriter& writer, const Mp4Tracks::Track& track) {
+        bool constantSize = !track.samples.empty();
+        for (const auto& sample : track.samples) {
+            if (sample.size != track.samples.front().size) {
+                constantSize = false;
+                break;
+            }
+        }
+
+        auto box = writer.beginFullBox("stsz", 0, 0);
+        if (constantSize) {
+            writer.u32(track.samples.front().size);
+            writer.u32(static_cast<uint32_t>(track.samples.size()));
+        } else {
+            writer.u32(0);
+            writer.u32(static_cast<uint32_t>(track.samples.size()));
+            for (const auto& sample : track.samples) {
+                writer.u32(sample.size);
+            }
+        }
+        writer.endBox(box);
+    }
+
+    void writeStsc(BoxWriter& writer, const std::vector<Chunk>& chunks) {
+        struct Entry {
+            uint32_t firstChunk;
+            uint32_t samplesPerChunk;
+            uint32_t sampleDescriptionIndex;
+        };
+
+        std::vector<Entry> entries;
+        for (size_t i = 0; i < chunks.size(); i++) {
+            if (entries.empty() ||
+                    entries.back().samplesPerChunk != chunks[i].samplesCount ||
+                    entries.back().sampleDescriptionIndex != chunks[i].sampleDescriptionIndex) {
+                entries.push_back({ static_cast<uint32_t>(i + 1), chunks[i].samplesCount, chunks[i].sampleDescriptionIndex });
+            }
+        }
+
+        auto box = writer.beginFullBox("stsc", 0, 0);
+        writer.u32(static_cast<uint32_t>(entries.size()));
+        for (const auto& entry : entries) {
+            writer.u32(entry.firstChunk);
+            writer.u32(entry.samplesPerChunk);
+            writer.u32(entry.sampleDescriptionIndex);
+        }
+        writer.endBox(box);
+    }
+
+    void writeChunkOffsets(
+                BoxWriter& writer,
+                const std::vector<Chunk>& chunks,
+                unsigned long int payloadOffset,
+                bool largeOffsets) {
+        auto box = writer.beginFullBox(largeOffsets ? "co64" : "stco", 0, 0);
+        writer.u32(static_cast<uint32_t>(chunks.size()));
+        for (const auto& chunk : chunks) {
+            if (largeOffsets) {
+                writer.u64(payloadOffset + chunk.offset);
+            } else {
+                writer.u32(static_cast<uint32_t>(payloadOffset + chunk.offset));
+            }
+        }
+        writer.endBox(box);
+    }
+
+    class MoovBuilder {
+    public:
+        MoovBuilder(
+                    const Mp4Tracks::Movie& movie,
+                    const std::vector<std::vector<Chunk>>& chunks,
+                    const std::vector<uint8_t>& moov,
+                    unsigned int moovHeaderSize)
+            : _movie{movie},
+            _chunks{chunks},
+            _moov{moov},
+            _moovHeaderSize{moovHeaderSize} {
+            computeStartOffsets();
+        }
+
+        BoxWriter build(unsigned long int payloadOffset, bool largeOffsets) {
+            _payloadOffset = payloadOffset;
+            _largeOffsets = largeOffsets;
+
+            BoxWriter writer;
+            auto box = writer.beginBox("moov");
+            for (const auto& child : rawChildren(_moov.data() + _moovHeaderSize, _moov.size() - _moovHeaderSize)) {
+                if (child.type == "mvhd") {
+                    writeHeaderWithDuration(writer, child, 12, movieDuration());
+                } else if (child.type == "trak") {
+                    writeTrak(writer, child);
+                } else if (child.type != "mvex") {
+                    writer.bytes(child.data, child.size);
+                }
+            }
+            writer.endBox(box);
+            return writer;
+        }
+
+    private:
+        size_t trackIndex(unsigned int trackId) const {
+            for (size_t i = 0; i < _movie.tracks.size(); i++) {
+                if (_movie.tracks[i].trackId == trackId) {
+                    return i;
+                }
+            }
+            throw std::runtime_error("Unknown track " + std::to_string(trackId));
+        }
+
+        /**
+         * Sample tables always start at zero, so the first decode time of every track
+         * is kept as an empty edit relative to the track that starts first
+         */
+        void computeStartOffsets() {
+            long double earliest = 0;
+            bool found = false;
+            for (const auto& track : _movie.tracks) {
+                if (!track.samples.empty()) {
+                    auto start = Helpers::toSeconds(track.samples.front().decodeTime, track.timescale);
+                    earliest = found ? std::min(earliest, start) : start;
+                    found = true;
+                }
+            }
+
+            for (const auto& track : _movie.tracks) {
+                uint64_t offset = 0;
+                if (!track.samples.empty()) {
+                    auto start = Helpers::toSeconds(track.samples.front().decodeTime, track.timescale);
+                    offset = static_cast<uint64_t>(std::llround((start - earliest) * _movie.timescale));
+                }
+                _startOffsets.push_back(offset);
+            }
+        }
+
+        uint64_t trackDuration(size_t index) const {
+            const auto& track = _movie.tracks[index];
+            return _startOffsets[index] + rescale(track.duration(), track.timescale, _movie.timescale);
+        }
+
+        uint64_t movieDuration() const {
+            uint64_t duration = 0;
+            for (size_t i = 0; i < _movie.tracks.size(); i++) {
+                duration = std::max(duration, trackDuration(i));
+            }
+            return duration;
+        }
+
+        void writeEdts(BoxWriter& writer, size_t index, int64_t mediaTime) {
+            auto offset = _startOffsets[index];
+            auto duration = rescale(_movie.tracks[index].duration(), _movie.tracks[index].timescale, _movie.timescale);
+            bool large = offset > INT32_MAX || duration > UINT32_MAX || mediaTime > INT32_MAX;
+
+            auto writeEntry = [&writer, large](uint64_t segmentDuration, int64_t time) {
+                if (large) {
+                    writer.u64(segmentDuration);
+                    writer.u64(static_cast<uint64_t>(time));
+                } else {
+                    writer.u32(static_cast<uint32_t>(segmentDuration));
+                    writer.u32(static_cast<uint32_t>(time));
+                }
+                // media rate 1.0
+                writer.u16(1);
+                writer.u16(0);
+            };
+
+            auto edts = writer.beginBox("edts");
+            auto elst = writer.beginFullBox("elst", large ? 1 : 0, 0);
+            writer.u32(offset > 0 ? 2 : 1);
+            if (offset > 0) {
+                writeEntry(offset, -1);
+            }
+            writeEntry(duration, mediaTime);
+            writer.endBox(elst);
+            writer.endBox(edts);
+        }
+
+        void writeTrak(BoxWriter& writer, const RawBox& trak) {
+            auto children = rawChildren(trak.data + trak.headerSize, trak.size - trak.headerSize);
+
+            size_t index = _movie.tracks.size();
+            for (const auto& child : children) {
+                if (child.type == "tkhd") {
+                    auto version = child.data[child.headerSize];
+                    index = trackIndex(Helpers::readU32(child.data + child.headerSize + 4 + (version == 1 ? 16 : 8)));
+                }
+            }
+            if (index == _movie.tracks.size()) {
+                throw std::runtime_error("Track without tkhd box");
+            }
+
+            int64_t mediaTime = 0;
+            bool hasEdits = false;
+            for (const auto& child : children) {
+                if (child.type == "edts") {
+                    hasEdits = true;
+                    mediaTime = firstMediaTime(child);
+                }
+            }
+
+            auto box = writer.beginBox("trak");
+            for (const auto& child : children) {
+                if (child.type == "tkhd") {
+                    writeHeaderWithDuration(writer, child, 16, trackDuration(index));
+                } else if (child.type == "edts") {
+                    // rewritten before mdia
+                } else if (child.type == "mdia") {
+                    if (hasEdits || _startOffsets[index] > 0) {
+                        writeEdts(writer, index, mediaTime);
+                    }
+                    writeMdia(writer, child, index);
+                } else {
+                    writer.bytes(child.data, child.size);
+                }
+            }
+            writer.endBox(box);
+        }
+
+        void writeMdia(BoxWriter& writer, const RawBox& mdia, size_t index) {
+            auto box = writer.beginBox("mdia");
+            for (const auto& child : rawChildren(mdia.data + mdia.headerSize, mdia.size - mdia.headerSize)) {
+                if (child.type == "mdhd") {
+                    writeHeaderWithDuration(writer, child, 12, _movie.tracks[index].duration());
+                } else if (child.type == "minf") {
+                    writeMinf(writer, child, index);
+                } else {
+                    writer.bytes(child.data, child.size);
+                }
+            }
+            writer.endBox(box);
+        }
+
+        void writeMinf(BoxWriter& writer, const RawBox& minf, size_t index) {
+            auto box = writer.beginBox("minf");
+            for (const auto& child : rawChildren(minf.data + minf.headerSize, minf.size - minf.headerSize)) {
+                if (child.type == "stbl") {
+                    writeStbl(writer, child, index);
+                } else {
+                    writer.bytes(child.data, child.size);
+                }
+            }
+            writer.endBox(box);
+        }
+
+        void writeStbl(BoxWriter& writer, const RawBox& stbl, size_t index) {
+            const auto& track = _movie.tracks[index];
+
+            auto box = writer.beginBox("stbl");
+            for (const auto& child : rawChildren(stbl.data + stbl.headerSize, stbl.size - stbl.headerSize)) {
+                // sample tables of a fragmented file are empty, everything except descriptions is rebuilt
+                if (child.type == "stsd") {
+                    writer.bytes(child.data, child.size);
+                }
+            }
+            writeStts(writer, track);
+            writeCtts(writer, track);
+            writeStss(writer, track);
+            writeStsz(writer, track);
+            writeStsc(writer, _chunks[index]);
+            writeChunkOffsets(writer, _chunks[index], _payloadOffset, _largeOffsets);
+            writer.endBox(box);
+        }
+
+        const Mp4Tracks::Movie& _movie;
+        const std::vector<std::vector<Chunk>>& _chunks;
+        const std::vector<uint8_t>& _moov;
+        unsigned int _moovHeaderSize;
+
+        std::vector<uint64_t> _startOffsets;
+
+        unsigned long int _payloadOffset {0};
+        bool _largeOffsets {false};
+    };
+
+    BoxWriter buildFtyp(const FileCopy::FileDescriptor& input, const Mp4Boxes::Box* ftyp) {
+        BoxWriter writer;
+        if (ftyp) {
+            auto bytes = FileCopy::readRange(input.get(), ftyp->offset, ftyp->size);
+            writer.bytes(bytes.data(), bytes.size());
+        } else {
+            auto box = writer.beginBox("ftyp");
+            writer.fourcc("isom");
+            writer.u32(512);
+            writer.fourcc("isom");
+            writer.fourcc("iso2");
+            writer.fourcc("mp41");
+            writer.endBox(box);
+        }
+        return writer;
+    }
+
+}
+
+std::string Defragmenter::Statistics::toString() const noexcept {
+    return "defragmented ->\r\n\r\ttracks: " + std::to_string(tracks) +
+        "\r\n\r\tsamples: " + std::to_string(samples) +
+        "\r\n\r\tpayload bytes: " + std::to_string(payloadBytes) +
+        "\r\n\r\toutput bytes: " + std::to_string(outputBytes) + "\r\n";
+}
+
+Defragmenter::Statistics Defragmenter::defragment(const Mp4Analyzer& analyzer, const std::string& outputPath) {
+    auto root = analyzer.rootBox();
+    if (!root) {
+        throw std::runtime_error("File must be parsed before defragmentation");
+    }
+
+    auto moovBox = root->findChild("moov");
+    if (!moovBox) {
+        throw std::runtime_error("File has no moov box");
+    }
+
+    auto movie = Mp4Tracks::collect(*root);
+    if (movie.fragments.empty()) {
+        throw std::runtime_error("File is not fragmented");
+    }
+
+    auto input = FileCopy::openForReading(analyzer.path());
+
+    // opening the output truncates it before the payload is copied
+    if (FileCopy::isSameFile(input.get(), outputPath)) {
+        throw std::runtime_error("Output " + outputPath + " is the input file");
+    }
+
+    auto ftyp = buildFtyp(input, root->findChild("ftyp"));
+    auto moov = FileCopy::readRange(input.get(), moovBox->offset, moovBox->size);
+
+    auto layout = buildPayloadLayout(movie);
+
+    std::vector<std::vector<Chunk>> chunks;
+    for (const auto& track : movie.tracks) {
+        chunks.push_back(buildChunks(movie, layout, track));
+    }
+
+    bool largeMdat = layout.totalSize + 8 > UINT32_MAX;
+    unsigned int mdatHeaderSize = largeMdat ? 16 : 8;
+
+    // chunk offset tables have a fixed size, so the moov size only depends on the offset width
+    MoovBuilder moovBuilder(movie, chunks, moov, moovBox->headerSize);
+    bool largeOffsets = false;
+    auto payloadOffset = ftyp.size() + moovBuilder.build(0, largeOffsets).size() + mdatHeaderSize;
+    if (payloadOffset + layout.totalSize > UINT32_MAX) {
+        largeOffsets = true;
+        payloadOffset = ftyp.size() + moovBuilder.build(0, largeOffsets).size() + mdatHeaderSize;
+    }
+    auto newMoov = moovBuilder.build(payloadOffset, largeOffsets);
+
+    BoxWriter mdatHeader;
+    if (largeMdat) {
+        mdatHeader.u32(1);
+        mdatHeader.fourcc("mdat");
+        mdatHeader.u64(layout.totalSize + 16);
+    } else {
+        mdatHeader.u32(static_cast<uint32_t>(layout.totalSize + 8));
+        mdatHeader.fourcc("mdat");
+    }
+
+    auto output = FileCopy::openForWriting(outputPath);
+    FileCopy::writeAll(output.get(), ftyp.buffer().data(), ftyp.size());
+    FileCopy::writeAll(output.get(), newMoov.buffer().data(), newMoov.size());
+    FileCopy::writeAll(output.get(), mdatHeader.buffer().data(), mdatHeader.size());
+
+    for (const auto& mdat : movie.mediaData) {
+        FileCopy::copyRange(input.get(), mdat.offset + mdat.headerSize, output.get(), mdat.size - mdat.headerSize);
+    }
+
+    Statistics statistics;
+    statistics.tracks = static_cast<unsigned int>(movie.tracks.size());
+    for (const auto& track : movie.tracks) {
+        statistics.samples += track.samples.size();
+    }
+    statistics.payloadBytes = layout.totalSize;
+    statistics.outputBytes = payloadOffset + layout.totalSize;
+    return statistics;
+}
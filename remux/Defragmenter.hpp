@@ -0,0 +1,24 @@
+#pragma once
+
+#include <string>
+
+class Mp4Analyzer;
+
+namespace Defragmenter {
+
+    struct Statistics {
+        unsigned int tracks {0};
+        unsigned long int samples {0};
+        unsigned long int payloadBytes {0};
+        unsigned long int outputBytes {0};
+
+        std::string toString() const noexcept;
+    };
+
+    /**
+     * Rewrites a parsed fragmented file as a progressive one:
+     * ftyp, moov with complete sample tables and a single mdat.
+     * Payload is moved with kernel copies, a whole source mdat at a time.
+     */
+    Statistics defragment(const Mp4Analyzer& analyzer, const std::string& outputPath);
+}
@@ -0,0 +1,348 @@
+#include "Segmenter.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include "../Mp4Analyzer.hpp"
+#include "../models/Mp4Boxes.hpp"
+#include "../models/Mp4Tracks.hpp"
+#include "../utils/BoxWriter.hpp"
+#include "../utils/FileCopy.hpp"
+#include "../utils/Helpers.hpp"
+
+namespace {
+
+    /**
+     * Samples [first, last) of one track that go into a segment
+     */
+    struct TrackRun {
+        size_t trackIndex {0};
+        size_t first {0};
+        size_t last {0};
+    };
+
+    struct SegmentPlan {
+        std::vector<TrackRun> runs;
+    };
+
+    size_t selectReferenceTrack(const Mp4Tracks::Movie& movie) {
+        // a track with non-sync samples (video) decides where segments may start
+        for (size_t i = 0; i < movie.tracks.size(); i++) {
+            for (const auto& sample : movie.tracks[i].samples) {
+                if (!sample.isSync()) {
+                    return i;
+                }
+            }
+        }
+        for (size_t i = 0; i < movie.tracks.size(); i++) {
+            if (!movie.tracks[i].samples.empty()) {
+                return i;
+            }
+        }
+        throw std::runtime_error("File has no samples");
+    }
+
+    unsigned long int toTicks(long double seconds, unsigned int timescale) {
+        if (seconds <= 0) {
+            return 0;
+        }
+        return static_cast<unsigned long int>(std::llround(seconds * (timescale ? timescale : 1)));
+    }
+
+    /**
+     * Segment boundaries in seconds of the tfdt timeline: starts of every segment and the end of the last one
+     */
+    std::vector<long double> planBoundaries(const Mp4Tracks::Track& reference, const Segmenter::Options& options) {
+        if (options.start < 0) {
+            throw std::runtime_error("Requested range starts before the media");
+        }
+        if (options.end >= 0 && options.end <= options.start) {
+            throw std::runtime_error("Requested range is empty");
+        }
+
+        const auto& samples = reference.samples;
+
+        // the range is measured from the first sample of the reference track, recordings rarely start at tfdt 0
+        auto origin = samples.front().decodeTime;
+        auto startTicks = origin + toTicks(options.start, reference.timescale);
+        auto endTicks = options.end < 0 ? std::numeric_limits<unsigned long int>::max() :
+                origin + toTicks(options.end, reference.timescale);
+        auto targetTicks = toTicks(options.segmentDuration, reference.timescale);
+
+        if (startTicks >= samples.back().decodeTime + samples.back().duration) {
+            throw std::runtime_error("Requested range starts after the end of the media");
+        }
+
+        size_t first = samples.size();
+        for (size_t i = 0; i < samples.size() && samples[i].decodeTime <= startTicks; i++) {
+            if (samples[i].isSync()) {
+                first = i;
+            }
+        }
+        if (first == samples.size()) {
+            for (size_t i = 0; i < samples.size(); i++) {
+                if (samples[i].isSync()) {
+                    first = i;
+                    break;
+                }
+            }
+        }
+        if (first == samples.size() || samples[first].decodeTime >= endTicks) {
+            throw std::runtime_error("Requested range contains no sync samples");
+        }
+
+        std::vector<long double> boundaries;
+        unsigned long int segmentStart = samples[first].decodeTime;
+        boundaries.push_back(Helpers::toSeconds(segmentStart, reference.timescale));
+
+        for (auto i = first + 1; i < samples.size() && samples[i].decodeTime < endTicks; i++) {
+            if (targetTicks > 0 && samples[i].isSync() && samples[i].decodeTime - segmentStart >= targetTicks) {
+                segmentStart = samples[i].decodeTime;
+                boundaries.push_back(Helpers::toSeconds(segmentStart, reference.timescale));
+            }
+        }
+
+        // other tracks keep their samples up to the requested end, not only up to the last video frame
+        boundaries.push_back(options.end < 0 ? std::numeric_limits<long double>::infinity() :
+                Helpers::toSeconds(origin, reference.timescale) + options.end);
+
+        return boundaries;
+    }
+
+    std::vector<SegmentPlan> planSegments(
+                const Mp4Tracks::Movie& movie,
+                size_t referenceIndex,
+                const std::vector<long double>& boundaries) {
+        std::vector<SegmentPlan> plans(boundaries.size() - 1);
+
+        for (size_t trackIndex = 0; trackIndex < movie.tracks.size(); trackIndex++) {
+            const auto& track = movie.tracks[trackIndex];
+            const auto& samples = track.samples;
+
+            std::vector<unsigned long int> trackBoundaries;
+            for (auto boundary : boundaries) {
+                trackBoundaries.push_back(std::isinf(boundary) ? std::numeric_limits<unsigned long int>::max() :
+                        toTicks(boundary, track.timescale));
+            }
+
+            size_t cursor = 0;
+            while (cursor < samples.size() && samples[cursor].decodeTime < trackBoundaries.front()) {
+                cursor++;
+            }
+
+            for (size_t segment = 0; segment < plans.size(); segment++) {
+                // a traf carries a single sample description index, a change starts another run
+                while (cursor < samples.size() && samples[cursor].decodeTime < trackBoundaries[segment + 1]) {
+                    auto first = cursor++;
+                    while (cursor < samples.size() && samples[cursor].decodeTime < trackBoundaries[segment + 1] &&
+                            samples[cursor].sampleDescriptionIndex == samples[first].sampleDescriptionIndex) {
+                        cursor++;
+                    }
+                    plans[segment].runs.push_back({ trackIndex, first, cursor });
+                }
+            }
+        }
+
+        // the reference track leads every segment
+        for (auto& plan : plans) {
+            std::stable_partition(plan.runs.begin(), plan.runs.end(), [referenceIndex](const TrackRun& run) {
+                return run.trackIndex == referenceIndex;
+            });
+        }
+
+        return plans;
+    }
+
+    void writeTraf(
+                BoxWriter& writer,
+                const Mp4Tracks::Track& track,
+                const TrackRun& run,
+                unsigned long int timeShift,
+                std::vector<size_t>& dataOffsetPositions) {
+        bool hasOffsets = false;
+        bool hasNegativeOffsets = false;
+        for (auto i = run.first; i < run.last; i++) {
+            hasOffsets |= track.samples[i].compositionTimeOffset != 0;
+            hasNegativeOffsets |= track.samples[i].compositionTimeOffset < 0;
+        }
+
+        auto traf = writer.beginBox("traf");
+
+        // sample description index, default-base-is-moof
+        auto tfhd = writer.beginFullBox("tfhd", 0, 0x00020000 | 0x00000002);
+        writer.u32(track.trackId);
+        writer.u32(track.samples[run.first].sampleDescriptionIndex);
+        writer.endBox(tfhd);
+
+        auto decodeTime = track.samples[run.first].decodeTime;
+        auto tfdt = writer.beginFullBox("tfdt", 1, 0);
+        writer.u64(decodeTime > timeShift ? decodeTime - timeShift : 0);
+        writer.endBox(tfdt);
+
+        // data offset, sample duration, size and flags, composition time offset
+        uint32_t trunFlags = 0x00000001 | 0x00000100 | 0x00000200 | 0x00000400;
+        if (hasOffsets) {
+            trunFlags |= 0x00000800;
+        }
+
+        auto trun = writer.beginFullBox("trun", hasNegativeOffsets ? 1 : 0, trunFlags);
+        writer.u32(static_cast<uint32_t>(run.last - run.first));
+        dataOffsetPositions.push_back(writer.size());
+        writer.u32(0);
+        for (auto i = run.first; i < run.last; i++) {
+            const auto& sample = track.samples[i];
+            writer.u32(sample.duration);
+            writer.u32(sample.size);
+            writer.u32(sample.flags);
+            if (hasOffsets) {
+                writer.u32(static_cast<uint32_t>(sample.compositionTimeOffset));
+            }
+        }
+        writer.endBox(trun);
+
+        writer.endBox(traf);
+    }
+
+    /**
+     * Copies samples of a run, merging samples that are stored back to back in the source
+     */
+    unsigned long int copyRun(int inFd, int outFd, const Mp4Tracks::Track& track, const TrackRun& run) {
+        unsigned long int copied = 0;
+        auto rangeStart = track.samples[run.first].offset;
+        auto rangeEnd = rangeStart;
+
+        for (auto i = run.first; i < run.last; i++) {
+            const auto& sample = track.samples[i];
+            if (sample.offset != rangeEnd) {
+                FileCopy::copyRange(inFd, rangeStart, outFd, rangeEnd - rangeStart);
+                copied += rangeEnd - rangeStart;
+                rangeStart = sample.offset;
+            }
+            rangeEnd = sample.offset + sample.size;
+        }
+
+        FileCopy::copyRange(inFd, rangeStart, outFd, rangeEnd - rangeStart);
+        copied += rangeEnd - rangeStart;
+        return copied;
+    }
+
+    FileCopy::FileDescriptor openOutput(const FileCopy::FileDescriptor& input, const std::string& path) {
+        // opening the output truncates it before the payload is copied
+        if (FileCopy::isSameFile(input.get(), path)) {
+            throw std::runtime_error("Output " + path + " is the input file");
+        }
+        return FileCopy::openForWriting(path);
+    }
+
+    void writeInitSegment(const FileCopy::FileDescriptor& input, const Mp4Boxes::Box& root, const std::string& path) {
+        auto output = openOutput(input, path);
+        for (auto box : root.children) {
+            if (box->type == "ftyp" || box->type == "moov") {
+                FileCopy::copyRange(input.get(), box->offset, output.get(), box->size);
+            }
+        }
+    }
+
+}
+
+std::string Segmenter::Statistics::toString() const noexcept {
+    return "segmented ->\r\n\r\tsegments: " + std::to_string(segments) +
+        "\r\n\r\tsamples: " + std::to_string(samples) +
+        "\r\n\r\tpayload bytes: " + std::to_string(payloadBytes) + "\r\n";
+}
+
+Segmenter::Statistics Segmenter::segment(const Mp4Analyzer& analyzer, const Options& options) {
+    auto root = analyzer.rootBox();
+    if (!root) {
+        throw std::runtime_error("File must be parsed before segmentation");
+    }
+
+    if (!root->findChild("moov")) {
+        throw std::runtime_error("File has no moov box");
+    }
+
+    auto movie = Mp4Tracks::collect(*root);
+    if (movie.fragments.empty()) {
+        throw std::runtime_error("File is not fragmented");
+    }
+
+    auto referenceIndex = selectReferenceTrack(movie);
+    const auto& reference = movie.tracks[referenceIndex];
+
+    auto boundaries = planBoundaries(reference, options);
+    auto plans = planSegments(movie, referenceIndex, boundaries);
+
+    auto input = FileCopy::openForReading(analyzer.path());
+    writeInitSegment(input, *root, options.outputPrefix + "init.mp4");
+
+    Statistics statistics;
+    auto sequenceNumber = options.firstSequenceNumber;
+
+    for (const auto& plan : plans) {
+        if (plan.runs.empty()) {
+            continue;
+        }
+
+        BoxWriter moof;
+        auto moofBox = moof.beginBox("moof");
+
+        auto mfhd = moof.beginFullBox("mfhd", 0, 0);
+        moof.u32(sequenceNumber);
+        moof.endBox(mfhd);
+
+        std::vector<size_t> dataOffsetPositions;
+        std::vector<unsigned long int> runSizes;
+        unsigned long int payloadSize = 0;
+
+        for (const auto& run : plan.runs) {
+            const auto& track = movie.tracks[run.trackIndex];
+            auto timeShift = toTicks(boundaries.front(), track.timescale);
+            writeTraf(moof, track, run, timeShift, dataOffsetPositions);
+
+            unsigned long int runSize = 0;
+            for (auto i = run.first; i < run.last; i++) {
+                runSize += track.samples[i].size;
+            }
+            runSizes.push_back(runSize);
+            payloadSize += runSize;
+            statistics.samples += run.last - run.first;
+        }
+        moof.endBox(moofBox);
+
+        bool largeMdat = payloadSize + 8 > UINT32_MAX;
+        unsigned long int dataOffset = moof.size() + (largeMdat ? 16 : 8);
+        for (size_t i = 0; i < plan.runs.size(); i++) {
+            if (dataOffset > static_cast<unsigned long int>(std::numeric_limits<int32_t>::max())) {
+                throw std::runtime_error("Segment is too large, use a shorter segment duration");
+            }
+            moof.patchU32(dataOffsetPositions[i], static_cast<uint32_t>(dataOffset));
+            dataOffset += runSizes[i];
+        }
+
+        BoxWriter mdatHeader;
+        if (largeMdat) {
+            mdatHeader.u32(1);
+            mdatHeader.fourcc("mdat");
+            mdatHeader.u64(payloadSize + 16);
+        } else {
+            mdatHeader.u32(static_cast<uint32_t>(payloadSize + 8));
+            mdatHeader.fourcc("mdat");
+        }
+
+        auto output = openOutput(input, options.outputPrefix + std::to_string(sequenceNumber) + ".m4s");
+        FileCopy::writeAll(output.get(), moof.buffer().data(), moof.size());
+        FileCopy::writeAll(output.get(), mdatHeader.buffer().data(), mdatHeader.size());
+
+        for (const auto& run : plan.runs) {
+            statistics.payloadBytes += copyRun(input.get(), output.get(), movie.tracks[run.trackIndex], run);
+        }
+
+        statistics.segments++;
+        sequenceNumber++;
+    }
+
+    return statistics;
+}
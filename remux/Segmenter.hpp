@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string>
+
+class Mp4Analyzer;
+
+namespace Segmenter {
+
+    struct Options {
+        /**
+         * Media time range in seconds from the first sample of the reference (video) track,
+         * not absolute tfdt times. Start snaps back to the preceding sync sample,
+         * negative end means the end of the file.
+         * A negative start, an empty range or a start after the end of the media is an error.
+         */
+        double start {0.0};
+        double end {-1.0};
+
+        /**
+         * Target duration of a segment in seconds, segments are cut on sync samples only.
+         * Zero puts the whole range into a single segment.
+         */
+        double segmentDuration {0.0};
+
+        unsigned int firstSequenceNumber {1};
+
+        /**
+         * Written files are <prefix>init.mp4 and <prefix><sequence number>.m4s
+         */
+        std::string outputPrefix;
+    };
+
+    struct Statistics {
+        unsigned int segments {0};
+        unsigned long int samples {0};
+        unsigned long int payloadBytes {0};
+
+        std::string toString() const noexcept;
+    };
+
+    /**
+     * Writes an init segment and new media segments with rebuilt moof boxes.
+     * Sample payload is spliced from the source file with kernel copies.
+     */
+    Statistics segment(const Mp4Analyzer& analyzer, const Options& options);
+}
@@ -0,0 +1,83 @@
+#include "BoxWriter.hpp"
+
+#include <stdexcept>
+
+void BoxWriter::u8(uint8_t value) {
+    _buffer.push_back(value);
+}
+
+void BoxWriter::u16(uint16_t value) {
+    _buffer.push_back(static_cast<uint8_t>(value >> 8));
+    _buffer.push_back(static_cast<uint8_t>(value));
+}
+
+void BoxWriter::u24(uint32_t value) {
+    _buffer.push_back(static_cast<uint8_t>(value >> 16));
+    _buffer.push_back(static_cast<uint8_t>(value >> 8));
+    _buffer.push_back(static_cast<uint8_t>(value));
+}
+
+void BoxWriter::u32(uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        _buffer.push_back(static_cast<uint8_t>(value >> shift));
+    }
+}
+
+void BoxWriter::u64(uint64_t value) {
+    for (int shift = 56; shift >= 0; shift -= 8) {
+        _buffer.push_back(static_cast<uint8_t>(value >> shift));
+    }
+}
+
+void BoxWriter::fourcc(const std::string& type) {
+    if (type.size() != 4) {
+        throw std::runtime_error("Invalid box type " + type);
+    }
+    _buffer.insert(_buffer.end(), type.cbegin(), type.cend());
+}
+
+void BoxWriter::bytes(const uint8_t* data, size_t length) {
+    _buffer.insert(_buffer.end(), data, data + length);
+}
+
+size_t BoxWriter::beginBox(const std::string& type) {
+    auto boxStart = _buffer.size();
+    u32(0);
+    fourcc(type);
+    return boxStart;
+}
+
+size_t BoxWriter::beginFullBox(const std::string& type, uint8_t version, uint32_t flags) {
+    auto boxStart = beginBox(type);
+    u8(version);
+    u24(flags);
+    return boxStart;
+}
+
+void BoxWriter::endBox(size_t boxStart) {
+    auto boxSize = _buffer.size() - boxStart;
+    if (boxSize > UINT32_MAX) {
+        throw std::runtime_error("Box is too large to be serialized");
+    }
+    patchU32(boxStart, static_cast<uint32_t>(boxSize));
+}
+
+void BoxWriter::patchU32(size_t position, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        _buffer[position + i] = static_cast<uint8_t>(value >> (24 - 8 * i));
+    }
+}
+
+void BoxWriter::patchU64(size_t position, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        _buffer[position + i] = static_cast<uint8_t>(value >> (56 - 8 * i));
+    }
+}
+
+size_t BoxWriter::size() const noexcept {
+    return _buffer.size();
+}
+
+const std::vector<uint8_t>& BoxWriter::buffer() const noexcept {
+    return _buffer;
+}
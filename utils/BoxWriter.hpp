@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Serializes boxes into an in-memory big-endian buffer.
+ * Box sizes are patched when the box is closed.
+ */
+class BoxWriter {
+public:
+    void u8(uint8_t value);
+    void u16(uint16_t value);
+    void u24(uint32_t value);
+    void u32(uint32_t value);
+    void u64(uint64_t value);
+    void fourcc(const std::string& type);
+    void bytes(const uint8_t* data, size_t length);
+
+    size_t beginBox(const std::string& type);
+    size_t beginFullBox(const std::string& type, uint8_t version, uint32_t flags);
+    void endBox(size_t boxStart);
+
+    void patchU32(size_t position, uint32_t value);
+    void patchU64(size_t position, uint64_t value);
+
+    size_t size() const noexcept;
+    const std::vector<uint8_t>& buffer() const noexcept;
+
+private:
+    std::vector<uint8_t> _buffer;
+};
@@ -1,6 +1,7 @@
 
 #include "CliParser.hpp"
 
+#include <array>
 #include <getopt.h>
 #include <stdarg.h>
 #include <cstring>
@@ -8,12 +9,25 @@
 #include <cassert>
 
 namespace {
-    constexpr const char short_opts[] = "p:f:l:t:h";
-    constexpr std::array<option, 6> long_opts = {
+    constexpr const char short_opts[] = "p:f:l:t:d:s:e:g:o:w:D:c:j:kF:Cb:h";
+    constexpr std::array<option, 19> long_opts = {
         option{ "path", 1, nullptr, 'p' },
         option{ "find", 1, nullptr, 'f' },
         option{ "level", 1, nullptr, 'l' },
         option{ "temp", 1, nullptr, 't' },
+        option{ "defrag", 1, nullptr, 'd' },
+        option{ "start", 1, nullptr, 's' },
+        option{ "end", 1, nullptr, 'e' },
+        option{ "segment", 1, nullptr, 'g' },
+        option{ "output", 1, nullptr, 'o' },
+        option{ "watch", 1, nullptr, 'w' },
+        option{ "daemon", 1, nullptr, 'D' },
+        option{ "cache", 1, nullptr, 'c' },
+        option{ "workers", 1, nullptr, 'j' },
+        option{ "checksum", 0, nullptr, 'k' },
+        option{ "fingerprints", 1, nullptr, 'F' },
+        option{ "compact", 0, nullptr, 'C' },
+        option{ "bench", 1, nullptr, 'b' },
         option{ "help", 0, nullptr, 'h' },
         option{ nullptr, 0, nullptr, 0 }
     };
@@ -28,7 +42,20 @@ namespace {
                     << "--path $path:       path to mp4 file" << std::endl
                     << "--find $string:     block name to find" << std::endl
                     << "--level $string:    level of the details (low/middle/high)" << std::endl
-                    << "--temp $int:        temp value, only for check" << std::endl;
+                    << "--temp $int:        temp value, only for check" << std::endl
+                    << "--defrag $path:     write fragmented file as progressive mp4 to $path" << std::endl
+                    << "--output $prefix:   write new fmp4 segments as $prefix{init.mp4,N.m4s}" << std::endl
+                    << "--start $seconds:   start of the range to extract, from the first video sample (snaps to sync sample)" << std::endl
+                    << "--end $seconds:     end of the range to extract, from the first video sample" << std::endl
+                    << "--segment $seconds: target duration of output segments" << std::endl
+                    << "--watch $path:      follow growing files in $path (file or directory), repeatable" << std::endl
+                    << "--daemon $socket:   serve queries on unix socket $socket" << std::endl
+                    << "--cache $int:       daemon cache size in megabytes" << std::endl
+                    << "--workers $int:     daemon worker threads, hashing threads" << std::endl
+                    << "--checksum:         print payload hash of every fragment and track run" << std::endl
+                    << "--fingerprints $path: report fragments already recorded in store $path" << std::endl
+                    << "--compact:          compare compact sample encoding with plain vectors, keep daemon cache compact" << std::endl
+                    << "--bench $int:       time trun decoders on $int synthetic samples per flag combination" << std::endl;
     }
 
     void error(
@@ -63,7 +90,23 @@ namespace {
         char* end;
         auto tempValue = strtol(optarg, &end, 0);
         if (*end || end == optarg) {
-            error(app, optarg, 't', "a value must be long");
+            error(app, optarg, option, "a value must be long");
+            return false;
+        }
+
+        value = tempValue;
+        return true;
+    }
+
+    bool parseSeconds(
+                        const char *const optarg,
+                        const int option,
+                        const char *const app,
+                        double& value) {
+        char* end;
+        auto tempValue = strtod(optarg, &end);
+        if (*end || end == optarg || tempValue < 0) {
+            error(app, optarg, option, "a value must be a non-negative number of seconds");
             return false;
         }
 
@@ -128,6 +171,60 @@ std::unique_ptr<CliParser::CliSettings> CliParser::cliParse(
             }
             settings->tempVarForCheck = value;
             break;
+        case 'd':
+            settings->defragmentPath = optarg;
+            break;
+        case 's':
+            if (!parseSeconds(optarg, 's', argv[0], settings->rangeStart)) {
+                return nullptr;
+            }
+            break;
+        case 'e':
+            if (!parseSeconds(optarg, 'e', argv[0], settings->rangeEnd)) {
+                return nullptr;
+            }
+            break;
+        case 'g':
+            if (!parseSeconds(optarg, 'g', argv[0], settings->segmentDuration)) {
+                return nullptr;
+            }
+            break;
+        case 'o':
+            settings->segmentPrefix = optarg;
+            break;
+        case 'w':
+            settings->watchPaths.push_back(optarg);
+            break;
+        case 'D':
+            settings->daemonSocket = optarg;
+            break;
+        case 'c':
+            if (!parseLong(optarg, 'c', argv[0], value) || value <= 0) {
+                return nullptr;
+            }
+            settings->cacheMegabytes = value;
+            break;
+        case 'j':
+            if (!parseLong(optarg, 'j', argv[0], value) || value <= 0) {
+                return nullptr;
+            }
+            settings->workers = value;
+            break;
+        case 'k':
+            settings->checksum = true;
+            break;
+        case 'F':
+            settings->fingerprintStore = optarg;
+            break;
+        case 'C':
+            settings->compact = true;
+            break;
+        case 'b':
+            if (!parseLong(optarg, 'b', argv[0], value) || value <= 0) {
+                return nullptr;
+            }
+            settings->benchmarkSamples = value;
+            break;
         
         default:
             break;
@@ -2,6 +2,7 @@
 
 #include <string>
 #include <memory>
+#include <vector>
 
 namespace CliParser {
 
@@ -17,6 +18,19 @@ namespace CliParser {
 		std::string boxToFind;
 		Level levelOfDetails{ Level::UNKNOWN };
 		long tempVarForCheck {0};
+		std::string defragmentPath;
+		std::string segmentPrefix;
+		double rangeStart {0.0};
+		double rangeEnd {-1.0};
+		double segmentDuration {0.0};
+		std::vector<std::string> watchPaths;
+		std::string daemonSocket;
+		long cacheMegabytes {512};
+		long workers {0};
+		bool checksum {false};
+		std::string fingerprintStore;
+		bool compact {false};
+		long benchmarkSamples {0};
 	};
 
 	std::unique_ptr<CliSettings> cliParse(const int argc, char *const *const argv);
@@ -0,0 +1,199 @@
+#include "FileCopy.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Helpers.hpp"
+
+namespace {
+
+    constexpr size_t MAX_CHUNK = 1UL << 30;
+    constexpr size_t FALLBACK_BUFFER_SIZE = 4UL << 20;
+
+    bool isUnsupported(int error) {
+        return error == ENOSYS || error == EXDEV || error == EINVAL ||
+                error == EOPNOTSUPP || error == EBADF;
+    }
+
+    /**
+     * @return number of bytes that were NOT copied because the syscall is unsupported
+     */
+    uint64_t copyWithCopyFileRange(int inFd, off_t& inOffset, int outFd, uint64_t length) {
+        while (length > 0) {
+            auto chunk = static_cast<size_t>(std::min<uint64_t>(length, MAX_CHUNK));
+            auto copied = copy_file_range(inFd, &inOffset, outFd, nullptr, chunk, 0);
+            if (copied < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (isUnsupported(errno)) {
+                    return length;
+                }
+                throw Helpers::systemError("copy_file_range failed");
+            }
+            if (copied == 0) {
+                throw std::runtime_error("Unexpected end of input file");
+            }
+            length -= copied;
+        }
+        return 0;
+    }
+
+    uint64_t copyWithSendfile(int inFd, off_t& inOffset, int outFd, uint64_t length) {
+        while (length > 0) {
+            auto chunk = static_cast<size_t>(std::min<uint64_t>(length, MAX_CHUNK));
+            auto copied = sendfile(outFd, inFd, &inOffset, chunk);
+            if (copied < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (isUnsupported(errno)) {
+                    return length;
+                }
+                throw Helpers::systemError("sendfile failed");
+            }
+            if (copied == 0) {
+                throw std::runtime_error("Unexpected end of input file");
+            }
+            length -= copied;
+        }
+        return 0;
+    }
+
+    void copyWithBuffer(int inFd, off_t inOffset, int outFd, uint64_t length) {
+        std::vector<uint8_t> buffer(static_cast<size_t>(std::min<uint64_t>(length, FALLBACK_BUFFER_SIZE)));
+        while (length > 0) {
+            auto chunk = static_cast<size_t>(std::min<uint64_t>(length, buffer.size()));
+            auto bytesRead = pread(inFd, buffer.data(), chunk, inOffset);
+            if (bytesRead < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw Helpers::systemError("pread failed");
+            }
+            if (bytesRead == 0) {
+                throw std::runtime_error("Unexpected end of input file");
+            }
+            FileCopy::writeAll(outFd, buffer.data(), bytesRead);
+            inOffset += bytesRead;
+            length -= bytesRead;
+        }
+    }
+
+}
+
+FileCopy::FileDescriptor::FileDescriptor(int fd)
+    : _fd{fd} {}
+
+FileCopy::FileDescriptor::~FileDescriptor() {
+    if (_fd >= 0) {
+        close(_fd);
+    }
+}
+
+FileCopy::FileDescriptor::FileDescriptor(FileDescriptor&& other) noexcept
+    : _fd{other._fd} {
+    other._fd = -1;
+}
+
+FileCopy::FileDescriptor& FileCopy::FileDescriptor::operator=(FileDescriptor&& other) noexcept {
+    if (this != &other) {
+        if (_fd >= 0) {
+            close(_fd);
+        }
+        _fd = other._fd;
+        other._fd = -1;
+    }
+    return *this;
+}
+
+int FileCopy::FileDescriptor::get() const noexcept {
+    return _fd;
+}
+
+bool FileCopy::FileDescriptor::isValid() const noexcept {
+    return _fd >= 0;
+}
+
+FileCopy::FileDescriptor FileCopy::openForReading(const std::string& path) {
+    FileDescriptor fd(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (!fd.isValid()) {
+        throw Helpers::systemError("Unable to open " + path);
+    }
+    return fd;
+}
+
+FileCopy::FileDescriptor FileCopy::openForWriting(const std::string& path) {
+    FileDescriptor fd(open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+    if (!fd.isValid()) {
+        throw Helpers::systemError("Unable to create " + path);
+    }
+    return fd;
+}
+
+bool FileCopy::isSameFile(int fd, const std::string& path) {
+    struct stat pathInfo;
+    if (stat(path.c_str(), &pathInfo) != 0) {
+        return false;
+    }
+
+    struct stat fdInfo;
+    if (fstat(fd, &fdInfo) != 0) {
+        throw Helpers::systemError("Unable to stat descriptor");
+    }
+
+    return pathInfo.st_dev == fdInfo.st_dev && pathInfo.st_ino == fdInfo.st_ino;
+}
+
+std::vector<uint8_t> FileCopy::readRange(int fd, uint64_t offset, size_t length) {
+    std::vector<uint8_t> data(length);
+    size_t done = 0;
+    while (done < length) {
+        auto bytesRead = pread(fd, data.data() + done, length - done, static_cast<off_t>(offset + done));
+        if (bytesRead < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw Helpers::systemError("pread failed");
+        }
+        if (bytesRead == 0) {
+            throw std::runtime_error("Unexpected end of input file");
+        }
+        done += bytesRead;
+    }
+    return data;
+}
+
+void FileCopy::writeAll(int fd, const uint8_t* data, size_t length) {
+    while (length > 0) {
+        auto written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw Helpers::systemError("write failed");
+        }
+        data += written;
+        length -= written;
+    }
+}
+
+void FileCopy::copyRange(int inFd, uint64_t inOffset, int outFd, uint64_t length) {
+    auto offset = static_cast<off_t>(inOffset);
+
+    auto remaining = copyWithCopyFileRange(inFd, offset, outFd, length);
+    if (remaining > 0) {
+        remaining = copyWithSendfile(inFd, offset, outFd, remaining);
+    }
+    if (remaining > 0) {
+        copyWithBuffer(inFd, offset, outFd, remaining);
+    }
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace FileCopy {
+
+    /**
+     * Owns a POSIX file descriptor, closes it on destruction
+     */
+    class FileDescriptor {
+    public:
+        FileDescriptor() = default;
+        explicit FileDescriptor(int fd);
+        ~FileDescriptor();
+
+        FileDescriptor(const FileDescriptor&) = delete;
+        FileDescriptor& operator=(const FileDescriptor&) = delete;
+        FileDescriptor(FileDescriptor&& other) noexcept;
+        FileDescriptor& operator=(FileDescriptor&& other) noexcept;
+
+        int get() const noexcept;
+        bool isValid() const noexcept;
+
+    private:
+        int _fd {-1};
+    };
+
+    FileDescriptor openForReading(const std::string& path);
+    FileDescriptor openForWriting(const std::string& path);
+
+    /**
+     * Whether path exists and is the same file (device and inode) as the one open as fd
+     */
+    bool isSameFile(int fd, const std::string& path);
+
+    /**
+     * Reads exactly length bytes of fd starting at offset
+     */
+    std::vector<uint8_t> readRange(int fd, uint64_t offset, size_t length);
+
+    /**
+     * Writes the whole buffer at the current position of fd
+     */
+    void writeAll(int fd, const uint8_t* data, size_t length);
+
+    /**
+     * Appends length bytes of inFd starting at inOffset to the current position of outFd.
+     * The data is moved inside the kernel with copy_file_range, then sendfile,
+     * and only falls back to a large user-space buffer when neither is supported.
+     */
+    void copyRange(int inFd, uint64_t inOffset, int outFd, uint64_t length);
+}
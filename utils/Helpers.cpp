@@ -0,0 +1,11 @@
+#include "Helpers.hpp"
+
+#include <cerrno>
+
+std::runtime_error Helpers::systemError(const std::string& what) {
+    return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+long double Helpers::toSeconds(unsigned long int time, unsigned int timescale) noexcept {
+    return timescale ? static_cast<long double>(time) / timescale : static_cast<long double>(time);
+}
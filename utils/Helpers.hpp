@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace Helpers {
+
+    /**
+     * Error of the last failed system call: "<what>: <strerror(errno)>"
+     */
+    std::runtime_error systemError(const std::string& what);
+
+    /**
+     * Seconds of a time in timescale units, a zero timescale is taken as 1
+     */
+    long double toSeconds(unsigned long int time, unsigned int timescale) noexcept;
+
+    /**
+     * Big-endian reads from unaligned memory, inline for the sample decoding loops
+     */
+    inline uint32_t readU32(const uint8_t* data) noexcept {
+        uint32_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return __builtin_bswap32(value);
+    }
+
+    inline uint64_t readU64(const uint8_t* data) noexcept {
+        uint64_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return __builtin_bswap64(value);
+    }
+}
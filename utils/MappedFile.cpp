@@ -0,0 +1,53 @@
+#include "MappedFile.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string& path) {
+    auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("Unable to open " + path + ": " + std::strerror(errno));
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        auto error = errno;
+        close(fd);
+        throw std::runtime_error("Unable to stat " + path + ": " + std::strerror(error));
+    }
+    _size = static_cast<size_t>(info.st_size);
+
+    if (_size > 0) {
+        auto data = mmap(nullptr, _size, PROT_READ, MAP_SHARED, fd, 0);
+        if (data == MAP_FAILED) {
+            auto error = errno;
+            close(fd);
+            throw std::runtime_error("Unable to map " + path + ": " + std::strerror(error));
+        }
+        _data = static_cast<const uint8_t*>(data);
+        // payload is read roughly front to back, let the kernel read ahead aggressively
+        madvise(data, _size, MADV_SEQUENTIAL);
+    }
+
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (_data) {
+        munmap(const_cast<uint8_t*>(_data), _size);
+    }
+}
+
+const uint8_t* MappedFile::data() const noexcept {
+    return _data;
+}
+
+size_t MappedFile::size() const noexcept {
+    return _size;
+}
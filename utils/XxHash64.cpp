@@ -0,0 +1,139 @@
+#include "XxHash64.hpp"
+
+#include <cstring>
+
+namespace {
+
+    constexpr uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+    constexpr uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+    constexpr uint64_t PRIME3 = 0x165667B19E3779F9ULL;
+    constexpr uint64_t PRIME4 = 0x85EBCA77C2B2AE63ULL;
+    constexpr uint64_t PRIME5 = 0x27D4EB2F165667C5ULL;
+
+    inline uint64_t rotateLeft(uint64_t value, int bits) {
+        return (value << bits) | (value >> (64 - bits));
+    }
+
+    inline uint64_t read64(const uint8_t* data) {
+        uint64_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    inline uint32_t read32(const uint8_t* data) {
+        uint32_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    inline uint64_t round(uint64_t accumulator, uint64_t input) {
+        accumulator += input * PRIME2;
+        accumulator = rotateLeft(accumulator, 31);
+        return accumulator * PRIME1;
+    }
+
+    inline uint64_t mergeRound(uint64_t accumulator, uint64_t value) {
+        accumulator ^= round(0, value);
+        return accumulator * PRIME1 + PRIME4;
+    }
+
+}
+
+XxHash64::XxHash64(uint64_t seed)
+    : _accumulators{ seed + PRIME1 + PRIME2, seed + PRIME2, seed, seed - PRIME1 },
+    _seed{seed} {}
+
+void XxHash64::update(const uint8_t* data, size_t length) {
+    _totalLength += length;
+
+    if (_buffered + length < sizeof(_buffer)) {
+        std::memcpy(_buffer + _buffered, data, length);
+        _buffered += length;
+        return;
+    }
+
+    if (_buffered) {
+        auto fill = sizeof(_buffer) - _buffered;
+        std::memcpy(_buffer + _buffered, data, fill);
+        for (int i = 0; i < 4; i++) {
+            _accumulators[i] = round(_accumulators[i], read64(_buffer + 8 * i));
+        }
+        data += fill;
+        length -= fill;
+        _buffered = 0;
+    }
+
+    // four independent lanes keep the multipliers busy
+    auto v1 = _accumulators[0];
+    auto v2 = _accumulators[1];
+    auto v3 = _accumulators[2];
+    auto v4 = _accumulators[3];
+    while (length >= 32) {
+        v1 = round(v1, read64(data));
+        v2 = round(v2, read64(data + 8));
+        v3 = round(v3, read64(data + 16));
+        v4 = round(v4, read64(data + 24));
+        data += 32;
+        length -= 32;
+    }
+    _accumulators[0] = v1;
+    _accumulators[1] = v2;
+    _accumulators[2] = v3;
+    _accumulators[3] = v4;
+
+    std::memcpy(_buffer, data, length);
+    _buffered = length;
+}
+
+uint64_t XxHash64::digest() const {
+    uint64_t result;
+    if (_totalLength >= 32) {
+        result = rotateLeft(_accumulators[0], 1) + rotateLeft(_accumulators[1], 7) +
+                rotateLeft(_accumulators[2], 12) + rotateLeft(_accumulators[3], 18);
+        for (int i = 0; i < 4; i++) {
+            result = mergeRound(result, _accumulators[i]);
+        }
+    } else {
+        result = _seed + PRIME5;
+    }
+
+    result += _totalLength;
+
+    const uint8_t* data = _buffer;
+    auto length = _buffered;
+
+    while (length >= 8) {
+        result ^= round(0, read64(data));
+        result = rotateLeft(result, 27) * PRIME1 + PRIME4;
+        data += 8;
+        length -= 8;
+    }
+
+    if (length >= 4) {
+        result ^= static_cast<uint64_t>(read32(data)) * PRIME1;
+        result = rotateLeft(result, 23) * PRIME2 + PRIME3;
+        data += 4;
+        length -= 4;
+    }
+
+    while (length > 0) {
+        result ^= (*data) * PRIME5;
+        result = rotateLeft(result, 11) * PRIME1;
+        data++;
+        length--;
+    }
+
+    result ^= result >> 33;
+    result *= PRIME2;
+    result ^= result >> 29;
+    result *= PRIME3;
+    result ^= result >> 32;
+
+    return result;
+}
+
+uint64_t XxHash64::hash(const uint8_t* data, size_t length, uint64_t seed) {
+    XxHash64 state(seed);
+    state.update(data, length);
+    return state.digest();
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Streaming XXH64, data may be fed in any number of pieces
+ */
+class XxHash64 {
+public:
+    explicit XxHash64(uint64_t seed = 0);
+
+    void update(const uint8_t* data, size_t length);
+    uint64_t digest() const;
+
+    static uint64_t hash(const uint8_t* data, size_t length, uint64_t seed = 0);
+
+private:
+    uint64_t _accumulators[4];
+    uint8_t _buffer[32];
+    size_t _buffered {0};
+    uint64_t _totalLength {0};
+    uint64_t _seed;
+};
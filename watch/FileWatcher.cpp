@@ -0,0 +1,231 @@
+#include "FileWatcher.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <set>
+#include <stdexcept>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../Mp4Analyzer.hpp"
+#include "../models/Mp4Boxes.hpp"
+#include "../utils/Helpers.hpp"
+
+namespace {
+
+    constexpr uint32_t DIRECTORY_EVENTS = IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM;
+    constexpr uint32_t FILE_EVENTS = IN_MODIFY | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF;
+
+    bool isRegularFile(const std::string& path, struct stat& info) {
+        return stat(path.c_str(), &info) == 0 && S_ISREG(info.st_mode);
+    }
+
+    bool isDirectory(const std::string& path) {
+        struct stat info;
+        return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+    }
+
+}
+
+FileWatcher::FileWatcher() {
+    _inotifyFd = inotify_init1(IN_CLOEXEC);
+    if (_inotifyFd < 0) {
+        throw Helpers::systemError("Unable to initialize inotify");
+    }
+}
+
+FileWatcher::~FileWatcher() {
+    close(_inotifyFd);
+}
+
+void FileWatcher::add(const std::string& path) {
+    if (isDirectory(path)) {
+        auto wd = inotify_add_watch(_inotifyFd, path.c_str(), DIRECTORY_EVENTS);
+        if (wd < 0) {
+            throw Helpers::systemError("Unable to watch " + path);
+        }
+        _directories[wd] = path;
+
+        auto directory = opendir(path.c_str());
+        if (!directory) {
+            throw Helpers::systemError("Unable to read " + path);
+        }
+        while (auto entry = readdir(directory)) {
+            if (entry->d_name[0] != '.') {
+                update(path + "/" + entry->d_name);
+            }
+        }
+        closedir(directory);
+    } else {
+        watchFile(path);
+        update(path);
+    }
+}
+
+void FileWatcher::watchFile(const std::string& path) {
+    auto wd = inotify_add_watch(_inotifyFd, path.c_str(), FILE_EVENTS);
+    if (wd < 0) {
+        throw Helpers::systemError("Unable to watch " + path);
+    }
+    _files[wd] = path;
+}
+
+void FileWatcher::run() {
+    // inotify_event must be aligned, see inotify(7)
+    alignas(inotify_event) char buffer[64 * 1024];
+
+    while (true) {
+        auto length = read(_inotifyFd, buffer, sizeof(buffer));
+        if (length < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw Helpers::systemError("Unable to read inotify events");
+        }
+
+        // a burst of writes produces many events, every changed file is parsed once per batch
+        std::set<std::string> changed;
+        std::set<std::string> unwatched;
+
+        for (char* position = buffer; position < buffer + length; ) {
+            auto event = reinterpret_cast<const inotify_event*>(position);
+            position += sizeof(inotify_event) + event->len;
+
+            std::string path;
+            auto directory = _directories.find(event->wd);
+            if (directory != _directories.end()) {
+                if (!event->len) {
+                    continue;
+                }
+                path = directory->second + "/" + event->name;
+            } else {
+                auto file = _files.find(event->wd);
+                if (file == _files.end()) {
+                    continue;
+                }
+                path = file->second;
+                if (event->mask & IN_MOVE_SELF) {
+                    // the watch follows the inode to its new name, the path is watched anew below
+                    inotify_rm_watch(_inotifyFd, event->wd);
+                }
+                if (event->mask & IN_IGNORED) {
+                    _files.erase(file);
+                    unwatched.insert(path);
+                }
+            }
+
+            if (event->mask & (IN_DELETE | IN_MOVED_FROM | IN_DELETE_SELF | IN_MOVE_SELF)) {
+                _checkpoints.erase(path);
+                changed.erase(path);
+            } else if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                // a new file under a known name, nothing of the old checkpoint applies
+                _checkpoints.erase(path);
+                changed.insert(path);
+            } else if (event->mask & (IN_MODIFY | IN_CLOSE_WRITE)) {
+                changed.insert(path);
+            }
+        }
+
+        // a watched file that was replaced by rename is followed under the same path
+        for (const auto& path : unwatched) {
+            struct stat info;
+            if (isRegularFile(path, info)) {
+                watchFile(path);
+                _checkpoints.erase(path);
+                changed.insert(path);
+            }
+        }
+
+        for (const auto& path : changed) {
+            update(path);
+        }
+    }
+}
+
+void FileWatcher::update(const std::string& path) {
+    struct stat info;
+    if (!isRegularFile(path, info)) {
+        return;
+    }
+    auto length = static_cast<size_t>(info.st_size);
+
+    auto& checkpoint = _checkpoints[path];
+
+    if (length < checkpoint.parsedLength ||
+            checkpoint.device != info.st_dev || checkpoint.inode != info.st_ino) {
+        // truncated or replaced, start from scratch
+        checkpoint = Checkpoint();
+        checkpoint.device = info.st_dev;
+        checkpoint.inode = info.st_ino;
+    }
+
+    if (checkpoint.failed || length == checkpoint.parsedLength) {
+        return;
+    }
+
+    Mp4Analyzer analyzer(false);
+    if (!analyzer.open(path)) {
+        return;
+    }
+
+    auto previousLength = checkpoint.parsedLength;
+
+    try {
+        analyzer.parse(checkpoint.parsedLength);
+        if (analyzer.parsedLength() == checkpoint.parsedLength) {
+            return;
+        }
+
+        for (auto box : analyzer.rootBox()->children) {
+            if (box->offset + box->size > analyzer.parsedLength()) {
+                // a box of size 0 is still being written
+                break;
+            }
+            checkpoint.collector.add(*box);
+        }
+    } catch (const std::exception& e) {
+        std::cout << path << ": " << e.what() << ", file is not watched anymore" << std::endl;
+        checkpoint.failed = true;
+        return;
+    }
+
+    const auto& movie = checkpoint.collector.movie();
+    checkpoint.fragments += movie.fragments.size();
+    for (const auto& track : movie.tracks) {
+        auto& progress = checkpoint.tracks[track.trackId];
+        if (progress.samples == 0 && !track.samples.empty()) {
+            progress.firstDecodeTime = track.samples.front().decodeTime;
+        }
+        progress.samples += track.samples.size();
+    }
+    checkpoint.parsedLength = analyzer.parsedLength();
+
+    report(path, checkpoint, previousLength);
+
+    checkpoint.collector.clearCollected();
+}
+
+void FileWatcher::report(const std::string& path, const Checkpoint& checkpoint, size_t previousLength) const {
+    const auto& movie = checkpoint.collector.movie();
+
+    std::cout << path << ": parsed " << checkpoint.parsedLength << " bytes (+" <<
+            checkpoint.parsedLength - previousLength << "), fragments " << checkpoint.fragments <<
+            " (+" << movie.fragments.size() << ")";
+
+    for (const auto& track : movie.tracks) {
+        auto progress = checkpoint.tracks.find(track.trackId);
+        if (progress == checkpoint.tracks.end()) {
+            continue;
+        }
+        auto duration = track.nextDecodeTime - progress->second.firstDecodeTime;
+        std::cout << "; track " << track.trackId << ": " << progress->second.samples << " samples, " <<
+                (track.timescale ? static_cast<double>(duration) / track.timescale : 0.0) << " s";
+    }
+
+    std::cout << std::endl;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <map>
+#include <string>
+
+#include "../models/Mp4Tracks.hpp"
+
+/**
+ * Follows append-only recordings with inotify.
+ * Every file keeps a checkpoint (end of the last complete top-level box and
+ * running per-track state), so only appended bytes are parsed when it grows.
+ */
+class FileWatcher {
+public:
+    FileWatcher();
+    ~FileWatcher();
+
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    /**
+     * Watches a single file or every file in a directory, existing content is parsed immediately
+     */
+    void add(const std::string& path);
+
+    /**
+     * Processes inotify events until an error occurs
+     */
+    void run();
+
+private:
+    struct TrackProgress {
+        unsigned long int samples {0};
+        unsigned long int firstDecodeTime {0};
+    };
+
+    struct Checkpoint {
+        unsigned long int device {0};
+        unsigned long int inode {0};
+        size_t parsedLength {0};
+        Mp4Tracks::Collector collector;
+        unsigned long int fragments {0};
+        std::map<unsigned int, TrackProgress> tracks;
+        bool failed {false};
+    };
+
+    void watchFile(const std::string& path);
+    void update(const std::string& path);
+    void report(const std::string& path, const Checkpoint& checkpoint, size_t previousLength) const;
+
+    int _inotifyFd {-1};
+    std::map<int, std::string> _directories;
+    std::map<int, std::string> _files;
+    std::map<std::string, Checkpoint> _checkpoints;
+};